@@ -0,0 +1,210 @@
+// runs the realtime callback on miniaudio's null backend with more and more tracks
+// playing and times every period against its deadline. no audio hardware needed.
+//
+//   cliwave_bench_callback --tracks 1,16,64,256 --seconds 5 --period 256 --record 1
+//
+// every track is one segment of a synthetic take that plays for the whole step,
+// so the disk readers and the mix loop are busy the way they would be on a real
+// session. --record also captures a take (silence, the null backend has no input)
+// so the capture path and its writer thread run too. prints json, with the largest
+// track count that never missed a deadline and stayed under --max-load at p99
+#include "engine.hpp"
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+struct StressConfig {
+    std::vector<uint32_t> tracks = {1, 4, 16, 64, 256};
+    double seconds = 5.0;
+    uint32_t period = 256;
+    uint32_t periods = 2;
+    uint32_t readers = 2;
+    uint32_t readAheadMs = 2000;
+    int takeRate = ENGINE_SAMPLE_RATE;
+    int takes = 8;
+    bool record = false;
+    double maxLoad = 70.0; // percent of the period at p99
+    std::string dir = "/tmp/cliwave-bench";
+    std::string out;
+};
+
+static void printUsage() {
+    fprintf(stderr,
+            "usage: cliwave_bench_callback [--tracks N,N..] [--seconds S] [--period FRAMES] [--periods N]\n"
+            "                              [--readers N] [--read-ahead MS] [--take-rate HZ] [--takes N]\n"
+            "                              [--record 0|1] [--max-load PERCENT] [--dir DIR] [--out FILE]\n");
+}
+
+static bool parseArgs(int argc, char** argv, StressConfig& cfg) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        if (arg == "--tracks") {
+            cfg.tracks.clear();
+            for (const char* p = value; *p;) {
+                char* end;
+                long n = strtol(p, &end, 10);
+                if (end == p || n <= 0 || (*end != ',' && *end != '\0')) return false;
+                cfg.tracks.push_back((uint32_t)n);
+                p = *end == ',' ? end + 1 : end;
+            }
+        }
+        else if (arg == "--seconds") cfg.seconds = atof(value);
+        else if (arg == "--period") cfg.period = (uint32_t)atoi(value);
+        else if (arg == "--periods") cfg.periods = (uint32_t)atoi(value);
+        else if (arg == "--readers") cfg.readers = (uint32_t)atoi(value);
+        else if (arg == "--read-ahead") cfg.readAheadMs = (uint32_t)atoi(value);
+        else if (arg == "--take-rate") cfg.takeRate = atoi(value);
+        else if (arg == "--takes") cfg.takes = atoi(value);
+        else if (arg == "--record") cfg.record = atoi(value) != 0;
+        else if (arg == "--max-load") cfg.maxLoad = atof(value);
+        else if (arg == "--dir") cfg.dir = value;
+        else if (arg == "--out") cfg.out = value;
+        else return false;
+    }
+    return !cfg.tracks.empty() && cfg.seconds > 0.0 && cfg.period > 0 && cfg.takes > 0 && cfg.takeRate >= 8000;
+}
+
+struct StepResult {
+    uint32_t tracks;
+    bool ok;
+    CallbackTiming timing;
+    PlaybackStats playback;
+    RecordingStats recording;
+    LatencyInfo latency;
+};
+
+static bool runStep(const StressConfig& cfg, const std::vector<std::string>& takes, uint32_t tracks, StepResult& result) {
+    result = StepResult();
+    result.tracks = tracks;
+
+    AudioEngineConfig engineConfig = audio_engine_config_init();
+    engineConfig.nullBackend = true;
+    engineConfig.periodSizeInFrames = cfg.period;
+    engineConfig.periods = cfg.periods;
+    engineConfig.readerThreads = cfg.readers;
+    engineConfig.readAheadMs = cfg.readAheadMs;
+    if (open_audio_devices(&engineConfig) != MA_SUCCESS) return false;
+
+    const uint64_t frames = (uint64_t)(cfg.seconds * ENGINE_SAMPLE_RATE);
+    std::vector<PlaybackSegment> segments(tracks);
+    for (uint32_t t = 0; t < tracks; t++) {
+        segments[t].filePath = takes[t % takes.size()].c_str();
+        segments[t].startFrame = 0;
+        segments[t].frameCount = frames;
+        segments[t].sourceOffset = 0;
+    }
+
+    bool ok = start_playback(segments.data(), tracks, 0, nullptr) == MA_SUCCESS;
+    std::string takePath = cfg.dir + "/stress_take.wav";
+    if (ok && cfg.record) ok = start_recording(takePath.c_str()) == MA_SUCCESS;
+
+    // start_playback already waited for the first buffers, only the steady state counts
+    PlaybackStats before;
+    get_playback_stats(&before);
+    reset_callback_timing();
+    if (ok) usleep((useconds_t)(cfg.seconds * 1e6));
+
+    get_callback_timing(&result.timing);
+    get_playback_stats(&result.playback);
+    result.playback.underrunFrames -= before.underrunFrames;
+    result.playback.underrunCount -= before.underrunCount;
+    get_latency_info(&result.latency);
+    if (cfg.record) {
+        get_recording_stats(&result.recording);
+        stop_recording();
+        unlink(takePath.c_str());
+    }
+    stop_playback();
+    close_audio_devices();
+    result.ok = ok;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    StressConfig cfg;
+    if (!parseArgs(argc, argv, cfg)) {
+        printUsage();
+        return 2;
+    }
+    mkdir(cfg.dir.c_str(), 0755);
+
+    // each take is a bit longer than a step so no source runs out early
+    std::vector<std::string> takes;
+    uint64_t takeFrames = (uint64_t)((cfg.seconds + 1.0) * cfg.takeRate);
+    for (int i = 0; i < cfg.takes; i++) {
+        char name[128];
+        snprintf(name, sizeof(name), "/stress_take_%d_%dhz_%llu.wav", i, cfg.takeRate, (unsigned long long)takeFrames);
+        std::string path = cfg.dir + name;
+        Rng rng = {1000ULL + i};
+        if (!writeSyntheticTake(path, cfg.takeRate, 2, takeFrames, rng)) {
+            fprintf(stderr, "Couldn't write %s\n", path.c_str());
+            return 1;
+        }
+        takes.push_back(path);
+    }
+
+    FILE* out = cfg.out.empty() ? stdout : fopen(cfg.out.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Couldn't open %s\n", cfg.out.c_str());
+        return 1;
+    }
+    std::vector<StepResult> results;
+    for (uint32_t tracks : cfg.tracks) {
+        if (tracks > MAX_PLAYBACK_SOURCES) {
+            fprintf(stderr, "skipping %u tracks, the engine plays at most %d sources\n", tracks, MAX_PLAYBACK_SOURCES);
+            continue;
+        }
+        StepResult result;
+        if (!runStep(cfg, takes, tracks, result)) fprintf(stderr, "%u tracks: couldn't start the engine\n", tracks);
+        results.push_back(result);
+        fprintf(stderr, "%u tracks: p99 load %.0f%%, %llu late callbacks\n", tracks,
+                callback_load_percentile(&result.timing, 0.99), (unsigned long long)result.timing.lateCallbacks);
+    }
+
+    const double deadlineUs = 1e6 * cfg.period / ENGINE_SAMPLE_RATE;
+    int64_t maxSafeTracks = 0;
+    fprintf(out, "{\n  \"benchmark\": \"callback\",\n  \"kernels\": \"%s\",\n", mix_kernels_name());
+    fprintf(out, "  \"config\": {\"seconds\": %g, \"period_frames\": %u, \"periods\": %u, \"deadline_us\": %.1f, "
+                 "\"readers\": %u, \"read_ahead_ms\": %u, \"take_rate\": %d, \"record\": %s, \"max_load\": %g},\n",
+            cfg.seconds, cfg.period, cfg.periods, deadlineUs, cfg.readers, cfg.readAheadMs, cfg.takeRate,
+            cfg.record ? "true" : "false", cfg.maxLoad);
+    fprintf(out, "  \"steps\": [");
+    for (size_t i = 0; i < results.size(); i++) {
+        const StepResult& r = results[i];
+        const CallbackTiming& t = r.timing;
+        double meanUs = t.callbacks ? t.totalNs / 1e3 / t.callbacks : 0.0;
+        double p50 = callback_load_percentile(&t, 0.5), p99 = callback_load_percentile(&t, 0.99),
+               p999 = callback_load_percentile(&t, 0.999);
+        bool safe = r.ok && t.callbacks > 0 && t.lateCallbacks == 0 && r.playback.underrunCount == 0 &&
+                    r.recording.overrunCount == 0 && p99 <= cfg.maxLoad;
+        if (safe) maxSafeTracks = std::max<int64_t>(maxSafeTracks, r.tracks);
+
+        fprintf(out, "%s\n    {\"tracks\": %u, \"ok\": %s, \"callbacks\": %llu, \"period_frames\": %u, "
+                     "\"mean_us\": %.2f, \"max_us\": %.2f, \"load_p50\": %.0f, \"load_p99\": %.0f, \"load_p999\": %.0f, "
+                     "\"late_callbacks\": %llu, \"underruns\": %u, \"capture_overruns\": %u, \"safe\": %s,\n"
+                     "     \"load_histogram\": {",
+                i ? "," : "", r.tracks, r.ok ? "true" : "false", (unsigned long long)t.callbacks,
+                r.latency.maxCallbackFrames, meanUs, t.maxNs / 1e3, p50, p99, p999,
+                (unsigned long long)t.lateCallbacks, r.playback.underrunCount, r.recording.overrunCount,
+                safe ? "true" : "false");
+        // sparse, "percent of the period": callbacks
+        bool firstBucket = true;
+        for (int b = 0; b < CALLBACK_LOAD_BUCKETS; b++) {
+            if (t.loadHistogram[b] == 0) continue;
+            fprintf(out, "%s\"%d\": %u", firstBucket ? "" : ", ", b, t.loadHistogram[b]);
+            firstBucket = false;
+        }
+        fprintf(out, "}}");
+    }
+    fprintf(out, "\n  ],\n  \"max_safe_tracks\": %lld\n}\n", (long long)maxSafeTracks);
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,207 @@
+// times the offline mixdown on a synthetic session and prints the results as json.
+//
+//   cliwave_bench_mixdown --tracks 16 --segments 64 --length 120 --threads 1,4 --out results.json
+//   cliwave_bench_mixdown --rates 44100,48000 --channels 1,2 --overlap 1.5 --repeat 3
+//
+// the takes are generated once into --dir and reused by later runs with the same
+// settings. the session is written next to them as bench.cws, so the same mix can
+// be run through "cliwave render" too. --min-realtime makes it exit 1 when any run
+// is slower than that, which is what a ci job wants
+#include "engine.hpp"
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <vector>
+
+struct BenchConfig {
+    int tracks = 8;
+    int segmentsPerTrack = 32;
+    double overlap = 1.0;        // how many segments of a track play at once on average
+    double lengthSeconds = 60.0; // session length
+    int takes = 8;               // different take files, the segments cycle through them
+    std::vector<int> rates = {ENGINE_SAMPLE_RATE};
+    std::vector<int> channels = {2};
+    std::vector<unsigned> threads = {1};
+    int repeat = 1;
+    unsigned seed = 1;
+    double minRealtime = 0.0;
+    std::string dir = "/tmp/cliwave-bench";
+    std::string out;
+};
+
+static void printUsage() {
+    fprintf(stderr,
+            "usage: cliwave_bench_mixdown [--tracks N] [--segments N] [--overlap X] [--length SECONDS]\n"
+            "                             [--takes N] [--rates R,R..] [--channels C,C..] [--threads T,T..]\n"
+            "                             [--repeat N] [--seed N] [--dir DIR] [--out FILE] [--min-realtime X]\n");
+}
+
+template <typename T>
+static bool parseList(const char* text, std::vector<T>& values) {
+    values.clear();
+    const char* p = text;
+    while (*p) {
+        char* end;
+        long v = strtol(p, &end, 10);
+        if (end == p || v < 0) return false;
+        values.push_back((T)v);
+        p = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return false;
+    }
+    return !values.empty();
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig& cfg) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        if (arg == "--tracks") cfg.tracks = atoi(value);
+        else if (arg == "--segments") cfg.segmentsPerTrack = atoi(value);
+        else if (arg == "--overlap") cfg.overlap = atof(value);
+        else if (arg == "--length") cfg.lengthSeconds = atof(value);
+        else if (arg == "--takes") cfg.takes = atoi(value);
+        else if (arg == "--rates") { if (!parseList(value, cfg.rates)) return false; }
+        else if (arg == "--channels") { if (!parseList(value, cfg.channels)) return false; }
+        else if (arg == "--threads") { if (!parseList(value, cfg.threads)) return false; }
+        else if (arg == "--repeat") cfg.repeat = atoi(value);
+        else if (arg == "--seed") cfg.seed = (unsigned)strtoul(value, nullptr, 10);
+        else if (arg == "--dir") cfg.dir = value;
+        else if (arg == "--out") cfg.out = value;
+        else if (arg == "--min-realtime") cfg.minRealtime = atof(value);
+        else return false;
+    }
+    for (int r : cfg.rates) if (r < 8000 || r > 384000) return false;
+    for (int c : cfg.channels) if (c < 1 || c > 8) return false;
+    return cfg.tracks > 0 && cfg.segmentsPerTrack > 0 && cfg.overlap > 0.0 && cfg.lengthSeconds > 0.0 &&
+           cfg.takes > 0 && cfg.repeat > 0;
+}
+
+// segments are spread evenly at random over the session, as long as they need to
+// be for the overlap asked for. each take is a little longer than a segment so
+// the segments can start somewhere inside it (sourceOffset)
+static bool buildSession(const BenchConfig& cfg, SessionData& session) {
+    const uint64_t sessionFrames = (uint64_t)(cfg.lengthSeconds * ENGINE_SAMPLE_RATE);
+    const uint64_t segmentFrames = std::max<uint64_t>(
+        1, std::min<uint64_t>(sessionFrames, (uint64_t)(cfg.overlap * sessionFrames / cfg.segmentsPerTrack)));
+    const uint64_t slackFrames = ENGINE_SAMPLE_RATE / 2;
+    Rng rng = {cfg.seed};
+
+    std::vector<std::string> takes;
+    for (int i = 0; i < cfg.takes; i++) {
+        int rate = cfg.rates[i % cfg.rates.size()];
+        int channels = cfg.channels[(i / cfg.rates.size()) % cfg.channels.size()];
+        // enough source frames at the take's own rate to cover the segment plus the slack
+        uint64_t frames = ((segmentFrames + slackFrames) * (uint64_t)rate + ENGINE_SAMPLE_RATE - 1) / ENGINE_SAMPLE_RATE;
+        char name[128];
+        snprintf(name, sizeof(name), "/take_%d_%dhz_%dch_%llu_s%u.wav", i, rate, channels, (unsigned long long)frames,
+                 cfg.seed);
+        std::string path = cfg.dir + name;
+        Rng takeRng = {cfg.seed * 7919ULL + i};
+        if (!writeSyntheticTake(path, rate, channels, frames, takeRng)) {
+            fprintf(stderr, "Couldn't write %s\n", path.c_str());
+            return false;
+        }
+        takes.push_back(path);
+    }
+
+    session.name = "bench";
+    session.lengthFrames = (int64_t)sessionFrames;
+    session.bufferFrames = 512;
+    session.recordDir = cfg.dir;
+    session.exportDir = cfg.dir;
+    session.tracks.assign(cfg.tracks, std::vector<Segment>());
+    for (int t = 0; t < cfg.tracks; t++) {
+        for (int s = 0; s < cfg.segmentsPerTrack; s++) {
+            Segment seg;
+            seg.startFrame = (int64_t)rng.below(sessionFrames - segmentFrames + 1);
+            seg.frameCount = (int64_t)segmentFrames;
+            seg.sourceOffset = (int64_t)rng.below(slackFrames);
+            seg.filename = takes[(t * cfg.segmentsPerTrack + s) % takes.size()];
+            session.tracks[t].push_back(seg);
+        }
+        std::sort(session.tracks[t].begin(), session.tracks[t].end(),
+                  [](const Segment& a, const Segment& b) { return a.startFrame < b.startFrame; });
+    }
+    return true;
+}
+
+static long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // kilobytes on linux
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    if (!parseArgs(argc, argv, cfg)) {
+        printUsage();
+        return 2;
+    }
+    mkdir(cfg.dir.c_str(), 0755);
+
+    SessionData session;
+    fprintf(stderr, "generating takes in %s...\n", cfg.dir.c_str());
+    if (!buildSession(cfg, session)) return 1;
+    writeSessionFile(session, cfg.dir + "/bench.cws");
+
+    FILE* out = cfg.out.empty() ? stdout : fopen(cfg.out.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Couldn't open %s\n", cfg.out.c_str());
+        return 1;
+    }
+
+    const double audioSeconds = double(session.lengthFrames) / ENGINE_SAMPLE_RATE;
+    const std::string exportPath = cfg.dir + "/bench_mix.wav";
+    bool tooSlow = false;
+
+    fprintf(out, "{\n  \"benchmark\": \"mixdown\",\n  \"kernels\": \"%s\",\n", mix_kernels_name());
+    fprintf(out, "  \"config\": {\"tracks\": %d, \"segments_per_track\": %d, \"overlap\": %g, \"length_s\": %g, "
+                 "\"takes\": %d, \"seed\": %u, \"rates\": [",
+            cfg.tracks, cfg.segmentsPerTrack, cfg.overlap, cfg.lengthSeconds, cfg.takes, cfg.seed);
+    for (size_t i = 0; i < cfg.rates.size(); i++) fprintf(out, "%s%d", i ? ", " : "", cfg.rates[i]);
+    fprintf(out, "], \"channels\": [");
+    for (size_t i = 0; i < cfg.channels.size(); i++) fprintf(out, "%s%d", i ? ", " : "", cfg.channels[i]);
+    fprintf(out, "]},\n  \"runs\": [");
+
+    bool first = true;
+    for (unsigned threads : cfg.threads) {
+        for (int r = 0; r < cfg.repeat; r++) {
+            MixdownStats stats;
+            if (!mixdownAllTracks(session.tracks, session.lengthFrames, exportPath, threads, &stats)) {
+                fprintf(stderr, "Mixdown failed: couldn't write %s\n", exportPath.c_str());
+                return 3;
+            }
+            double realtime = stats.totalSeconds > 0 ? audioSeconds / stats.totalSeconds : 0.0;
+            // what went in (decoded f32) and what came out (the 16 bit file), per wall second
+            double decodedMb = double(stats.decodedFrames) * ENGINE_CHANNELS * sizeof(float) / 1e6;
+            double outputMb = double(stats.frames) * ENGINE_CHANNELS * sizeof(int16_t) / 1e6;
+            if (cfg.minRealtime > 0 && realtime < cfg.minRealtime) tooSlow = true;
+
+            fprintf(out, "%s\n    {\"threads\": %u, \"repeat\": %d, \"wall_s\": %.6f, \"audio_s\": %.3f, "
+                         "\"realtime_factor\": %.2f, \"decoded_mb_per_s\": %.2f, \"output_mb_per_s\": %.2f, "
+                         "\"peak_rss_kb\": %ld, \"stages_thread_s\": {\"decode\": %.6f, \"mix\": %.6f, "
+                         "\"normalize\": %.6f, \"encode\": %.6f}}",
+                    first ? "" : ",", stats.threads, r, stats.totalSeconds, audioSeconds, realtime,
+                    stats.totalSeconds > 0 ? decodedMb / stats.totalSeconds : 0.0,
+                    stats.totalSeconds > 0 ? outputMb / stats.totalSeconds : 0.0, peakRssKb(), stats.decodeSeconds,
+                    stats.mixSeconds, stats.normalizeSeconds, stats.encodeSeconds);
+            first = false;
+            fprintf(stderr, "threads %u run %d: %.1fx realtime\n", stats.threads, r, realtime);
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+
+    if (tooSlow) {
+        fprintf(stderr, "slower than --min-realtime %g\n", cfg.minRealtime);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// synthetic takes for the benchmarks, nothing in here is timed
+#include "engine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// same numbers on every machine, so two runs with the same seed mix the same session
+struct Rng {
+    uint64_t state;
+    uint32_t next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (uint32_t)(state >> 33);
+    }
+    uint64_t below(uint64_t n) { return n ? ((uint64_t)next() << 31 ^ next()) % n : 0; }
+};
+
+// a few detuned sines and some noise, loud enough that the mix has to be normalized
+inline bool writeSyntheticTake(const std::string& path, int rate, int channels, uint64_t frames, Rng& rng) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) return true;
+
+    ma_encoder_config cfg = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, channels, rate);
+    ma_encoder enc;
+    std::string tmpPath = path + ".tmp";
+    if (ma_encoder_init_file(tmpPath.c_str(), &cfg, &enc) != MA_SUCCESS) return false;
+
+    double freq = 55.0 * (1 + rng.below(24));
+    std::vector<int16_t> chunk(4096 * (size_t)channels);
+    for (uint64_t done = 0; done < frames;) {
+        uint64_t n = std::min<uint64_t>(4096, frames - done);
+        for (uint64_t f = 0; f < n; f++) {
+            double t = double(done + f) / rate;
+            for (int c = 0; c < channels; c++) {
+                double v = 0.5 * sin(2 * M_PI * freq * (1 + 0.01 * c) * t) + 0.2 * sin(2 * M_PI * freq * 3.01 * t);
+                v += 0.1 * ((double)(rng.next() & 0xffff) / 32768.0 - 1.0);
+                chunk[f * channels + c] = (int16_t)(v * 32000);
+            }
+        }
+        ma_encoder_write_pcm_frames(&enc, chunk.data(), n, nullptr);
+        done += n;
+    }
+    ma_encoder_uninit(&enc);
+    return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
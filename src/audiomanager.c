@@ -1,19 +1,130 @@
-#include "dependencies/miniaudio.h"
+#include "audiomanager.h"
+#include "mixkernels.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 
-// global vars to manage recording
+// how much audio the capture ring can hold before the callback starts dropping input
+#define RECORD_RING_SECONDS 2
+// how often the writer thread wakes up to drain the ring
+#define RECORD_WRITER_INTERVAL_MS 20
+
+// global vars to manage recording.
+// the callback only copies into the ring, the writer thread does all the file io
 typedef struct {
-    ma_device device;
     ma_encoder encoder;
-    bool isRecording;
+    ma_pcm_rb ring;
+    pthread_t writer;
+    atomic_bool stopWriter;
+    atomic_bool isRecording;
+    atomic_uint_fast64_t framesCaptured;
+    atomic_uint_fast64_t framesWritten;
+    atomic_uint_fast64_t overrunFrames;
+    atomic_uint_fast32_t overrunCount;
+    atomic_uint_fast64_t startFrame; // transport frame of the first captured frame
+    uint32_t ringCapacity;
     bool isInitialized;
 } AudioRecorder;
 
+// how often the disk readers wake up to top up the source rings
+#define READER_INTERVAL_MS 5
+// start_playback waits (at most this long) for the sources at the playhead to be buffered
+#define PRIME_TIMEOUT_MS 1000
+
+// playback slots go FREE -> LOADING -> QUEUED -> READY -> (FINISHED) -> DETACHING -> DETACHED -> FREE.
+// the ui fills a slot in and queues it, a disk reader opens it once it gets close
+// to the playhead and keeps its ring topped up, the callback only ever reads the
+// ring of READY slots. only the callback moves DETACHING -> DETACHED, so once a
+// reader sees DETACHED it knows nobody else is looking at the slot and frees it.
+enum {
+    SOURCE_FREE,
+    SOURCE_LOADING,
+    SOURCE_QUEUED,
+    SOURCE_READY,
+    SOURCE_FINISHED,
+    SOURCE_DETACHING,
+    SOURCE_DETACHED
+};
+
+typedef struct {
+    char* filePath;
+    ma_decoder decoder;   // reader only
+    ma_pcm_rb ring;       // reader writes, callback reads
+    uint64_t startFrame;
+    uint64_t endFrame;
+    uint64_t sourceOffset;
+    uint64_t writeFrame;  // reader: timeline frame of the next frame going into the ring
+    uint64_t readFrame;   // callback: timeline frame of the next frame coming out of the ring
+    atomic_bool eof;      // reader has put everything there is into the ring
+    bool hasResources;    // reader only, decoder and ring are allocated
+    atomic_int state;
+} PlaybackSource;
+
+#define NO_FRAME UINT64_MAX
+
+// the session clock. only the callback moves it, by exactly the frames it
+// processed, everything else just reads it (or asks for a locate)
+typedef struct {
+    atomic_uint_fast64_t position; // timeline frame the next callback starts at
+    atomic_uint_fast64_t pendingLocate; // set by the ui, applied by the callback
+    atomic_bool rolling;
+} Transport;
+
+// the callback mixes every READY source that overlaps the period it's asked for
+typedef struct {
+    PlaybackSource* sources;
+    atomic_uint sourceHighWater; // slots past this were never used, nobody looks at them
+    atomic_uint_fast64_t underrunFrames;
+    atomic_uint_fast32_t underrunCount;
+    uint32_t readAheadFrames;
+} AudioPlayer;
+
+// what the callback has been up to. only the callback writes it, and it bumps seq
+// to odd before and back to even after, so readers can tell they got a torn copy
+// and read it again (a seqlock). the fields are relaxed atomics only so that
+// reading one mid-write isn't undefined, the callback never waits on anything
+typedef struct {
+    atomic_uint seq;
+    atomic_bool resetRequested;
+    atomic_uint_fast64_t callbacks;
+    atomic_uint_fast64_t lateCallbacks;
+    atomic_uint_fast64_t totalNs;
+    atomic_uint_fast64_t maxNs;
+    atomic_uint_fast64_t lastNs;
+    atomic_uint_fast64_t totalFrames;
+    atomic_uint_fast64_t underruns;
+    atomic_uint_fast64_t overruns;
+    atomic_uint_fast32_t loadHistogram[CALLBACK_LOAD_BUCKETS];
+} CallbackTelemetry;
+
+// the one device that lives for the whole DAW session (duplex if there's an input)
+typedef struct {
+    ma_device device;
+    pthread_t readers[MAX_READER_THREADS];
+    uint32_t readerCount;
+    atomic_bool stopReaders;
+    atomic_uint_fast64_t callbackCount;
+    atomic_uint lastCallbackFrames;
+    atomic_uint maxCallbackFrames;
+    uint32_t requestedPeriodFrames;
+    int eventFd;                      // readable when the ui has something new to draw
+    atomic_bool notifyPending;        // one write per wakeup, however many callbacks happen in between
+    atomic_uint_fast64_t notifyInterval; // playhead distance (frames) worth waking the ui for
+    CallbackTelemetry telemetry;
+    ma_context context;               // only used for the null backend
+    bool hasContext;
+    bool hasCapture;
+    bool isOpen;
+} AudioEngine;
+
 void sleep_ms(long ms) {
     struct timespec ts;
     ts.tv_sec = ms / 1000;
@@ -21,163 +132,901 @@ void sleep_ms(long ms) {
     nanosleep(&ts, NULL);
 }
 
+static Transport g_transport = {0};
 static AudioRecorder g_recorder = {0};
+static AudioPlayer g_player = {0};
+static AudioEngine g_engine = {.eventFd = -1};
+
+static void capture_process(AudioRecorder* pRecorder, ma_device* pDevice, const void* pInput, uint32_t frameCount, uint64_t blockStart)
+{
+    if (!atomic_load_explicit(&pRecorder->isRecording, memory_order_acquire) || pInput == NULL) return;
+
+    // the take starts exactly where this period sits on the timeline
+    if (atomic_load_explicit(&pRecorder->startFrame, memory_order_relaxed) == NO_FRAME) {
+        atomic_store_explicit(&pRecorder->startFrame, blockStart, memory_order_relaxed);
+    }
+
+    const uint32_t bpf = ma_get_bytes_per_frame(pDevice->capture.format, pDevice->capture.channels);
+    const uint8_t* pSrc = (const uint8_t*)pInput;
+    uint32_t remaining = frameCount;
+
+    // at most two goes, the ring can wrap once
+    while (remaining > 0) {
+        uint32_t frames = remaining;
+        void* pDst;
+        if (ma_pcm_rb_acquire_write(&pRecorder->ring, &frames, &pDst) != MA_SUCCESS || frames == 0) break;
+        ma_copy_pcm_frames(pDst, pSrc, frames, pDevice->capture.format, pDevice->capture.channels);
+        ma_pcm_rb_commit_write(&pRecorder->ring, frames);
+        pSrc += (size_t)frames * bpf;
+        remaining -= frames;
+    }
+
+    atomic_fetch_add_explicit(&pRecorder->framesCaptured, frameCount - remaining, memory_order_relaxed);
+    if (remaining > 0) {
+        // writer fell behind, whatever didn't fit is lost
+        atomic_fetch_add_explicit(&pRecorder->overrunFrames, remaining, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pRecorder->overrunCount, 1, memory_order_relaxed);
+    }
+}
+
+// mixes one READY source into the block. the ring is tagged with readFrame so the
+// source stays on the timeline even after the reader fell behind for a while
+static void mix_source(AudioPlayer* pPlayer, PlaybackSource* pSource, float* pOut, uint64_t blockStart, uint64_t blockEnd)
+{
+    uint64_t from = pSource->startFrame > blockStart ? pSource->startFrame : blockStart;
+    uint64_t to = pSource->endFrame < blockEnd ? pSource->endFrame : blockEnd;
+
+    // throw away whatever arrived too late to be played
+    if (pSource->readFrame < from) {
+        uint64_t stale = from - pSource->readFrame;
+        uint32_t available = ma_pcm_rb_available_read(&pSource->ring);
+        uint32_t skip = stale < available ? (uint32_t)stale : available;
+        ma_pcm_rb_seek_read(&pSource->ring, skip);
+        pSource->readFrame += skip;
+    }
+
+    if (pSource->readFrame == from) {
+        while (from < to) {
+            uint32_t frames = (uint32_t)(to - from);
+            void* pSrc;
+            if (ma_pcm_rb_acquire_read(&pSource->ring, &frames, &pSrc) != MA_SUCCESS || frames == 0) break;
+            mix_accumulate(pOut + (size_t)(from - blockStart) * ENGINE_CHANNELS, (const float*)pSrc, (size_t)frames * ENGINE_CHANNELS);
+            ma_pcm_rb_commit_read(&pSource->ring, frames);
+            from += frames;
+            pSource->readFrame += frames;
+        }
+    }
+
+    bool eof = atomic_load_explicit(&pSource->eof, memory_order_acquire);
+    bool drained = ma_pcm_rb_available_read(&pSource->ring) == 0;
+    if (from < to && !(eof && drained)) {
+        // the reader didn't get there in time
+        atomic_fetch_add_explicit(&pPlayer->underrunFrames, to - from, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pPlayer->underrunCount, 1, memory_order_relaxed);
+    }
+
+    if (pSource->readFrame >= pSource->endFrame || (eof && drained)) {
+        int expected = SOURCE_READY;
+        atomic_compare_exchange_strong(&pSource->state, &expected, SOURCE_FINISHED);
+    }
+}
+
+static void playback_process(AudioPlayer* pPlayer, float* pOut, uint32_t frameCount, uint64_t blockStart, bool rolling)
+{
+    uint32_t highWater = atomic_load_explicit(&pPlayer->sourceHighWater, memory_order_acquire);
+
+    // acknowledge detaches first, even while stopped
+    for (uint32_t i = 0; i < highWater; ++i) {
+        int expected = SOURCE_DETACHING;
+        atomic_compare_exchange_strong(&pPlayer->sources[i].state, &expected, SOURCE_DETACHED);
+    }
+
+    if (pOut == NULL || !rolling) return;
+
+    uint64_t blockEnd = blockStart + frameCount;
+
+    for (uint32_t i = 0; i < highWater; ++i) {
+        PlaybackSource* pSource = &pPlayer->sources[i];
+        int state = atomic_load_explicit(&pSource->state, memory_order_acquire);
+        if (state != SOURCE_READY && state != SOURCE_QUEUED) continue;
+        if (pSource->endFrame <= blockStart || pSource->startFrame >= blockEnd) continue;
+
+        if (state == SOURCE_READY) {
+            mix_source(pPlayer, pSource, pOut, blockStart, blockEnd);
+        } else if (state == SOURCE_QUEUED) {
+            // should have been opened by now
+            atomic_fetch_add_explicit(&pPlayer->underrunFrames, frameCount, memory_order_relaxed);
+            atomic_fetch_add_explicit(&pPlayer->underrunCount, 1, memory_order_relaxed);
+        }
+    }
+}
+
+// wakes up the ui. eventfd writes never block, and only the first one since the
+// ui last looked actually happens
+static void notify_ui(AudioEngine* pEngine)
+{
+    if (pEngine->eventFd < 0) return;
+    if (atomic_exchange_explicit(&pEngine->notifyPending, true, memory_order_acq_rel)) return;
+    uint64_t one = 1;
+    ssize_t written = write(pEngine->eventFd, &one, sizeof(one));
+    (void)written;
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// only ever called with nobody else writing, so no read-modify-write needed
+static void bump(atomic_uint_fast64_t* pValue, uint64_t n)
+{
+    atomic_store_explicit(pValue, atomic_load_explicit(pValue, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static void clear_telemetry(CallbackTelemetry* pTelemetry)
+{
+    atomic_uint_fast64_t* counters[] = {&pTelemetry->callbacks, &pTelemetry->lateCallbacks, &pTelemetry->totalNs,
+                                        &pTelemetry->maxNs, &pTelemetry->lastNs, &pTelemetry->totalFrames,
+                                        &pTelemetry->underruns, &pTelemetry->overruns};
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+        atomic_store_explicit(counters[i], 0, memory_order_relaxed);
+    }
+    for (int i = 0; i < CALLBACK_LOAD_BUCKETS; ++i) {
+        atomic_store_explicit(&pTelemetry->loadHistogram[i], 0, memory_order_relaxed);
+    }
+}
 
-void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, uint32_t frameCount)
+// where the time of one callback went, next to the period it had to fit in
+static void record_callback_time(CallbackTelemetry* pTelemetry, uint64_t ns, uint32_t frameCount, bool underrun, bool overrun)
 {
-    AudioRecorder* pRecorder = (AudioRecorder*)pDevice->pUserData;
-    
-    if (pRecorder->isRecording && pInput != NULL) {
-        ma_encoder_write_pcm_frames(&pRecorder->encoder, pInput, frameCount, NULL);
+    uint64_t deadlineNs = (uint64_t)frameCount * 1000000000ULL / ENGINE_SAMPLE_RATE;
+    uint64_t load = deadlineNs > 0 ? ns * 100 / deadlineNs : CALLBACK_LOAD_BUCKETS - 1;
+    if (load >= CALLBACK_LOAD_BUCKETS) load = CALLBACK_LOAD_BUCKETS - 1;
+
+    unsigned seq = atomic_load_explicit(&pTelemetry->seq, memory_order_relaxed);
+    atomic_store_explicit(&pTelemetry->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    if (atomic_exchange_explicit(&pTelemetry->resetRequested, false, memory_order_acquire)) clear_telemetry(pTelemetry);
+    uint32_t bucket = (uint32_t)atomic_load_explicit(&pTelemetry->loadHistogram[load], memory_order_relaxed);
+    atomic_store_explicit(&pTelemetry->loadHistogram[load], bucket + 1, memory_order_relaxed);
+    bump(&pTelemetry->callbacks, 1);
+    bump(&pTelemetry->totalNs, ns);
+    bump(&pTelemetry->totalFrames, frameCount);
+    if (ns > deadlineNs) bump(&pTelemetry->lateCallbacks, 1);
+    if (underrun) bump(&pTelemetry->underruns, 1);
+    if (overrun) bump(&pTelemetry->overruns, 1);
+    if (ns > atomic_load_explicit(&pTelemetry->maxNs, memory_order_relaxed)) {
+        atomic_store_explicit(&pTelemetry->maxNs, ns, memory_order_relaxed);
+    }
+    atomic_store_explicit(&pTelemetry->lastNs, ns, memory_order_relaxed);
+
+    atomic_store_explicit(&pTelemetry->seq, seq + 2, memory_order_release);
+}
+
+static void engine_callback(ma_device* pDevice, void* pOutput, const void* pInput, uint32_t frameCount)
+{
+    AudioEngine* pEngine = (AudioEngine*)pDevice->pUserData;
+    TRACE_THREAD_NAME("audio callback");
+    TRACE_BEGIN("callback");
+    uint64_t callbackStart = now_ns();
+    uint64_t underrunsBefore = atomic_load_explicit(&g_player.underrunCount, memory_order_relaxed);
+    uint64_t overrunsBefore = atomic_load_explicit(&g_recorder.overrunCount, memory_order_relaxed);
+    uint64_t takeStartBefore = atomic_load_explicit(&g_recorder.startFrame, memory_order_relaxed);
+
+    // transport_start publishes the locate before rolling, so read them the other way round
+    bool rolling = atomic_load_explicit(&g_transport.rolling, memory_order_acquire);
+    uint64_t locate = atomic_exchange_explicit(&g_transport.pendingLocate, NO_FRAME, memory_order_acq_rel);
+    if (locate != NO_FRAME) atomic_store_explicit(&g_transport.position, locate, memory_order_relaxed);
+    uint64_t blockStart = atomic_load_explicit(&g_transport.position, memory_order_relaxed);
+
+    TRACE_BEGIN("capture");
+    capture_process(&g_recorder, pDevice, pInput, frameCount, blockStart);
+    TRACE_END("capture");
+    TRACE_BEGIN("mix sources");
+    playback_process(&g_player, (float*)pOutput, frameCount, blockStart, rolling); // miniaudio hands this over already silenced
+    TRACE_END("mix sources");
+
+    if (rolling) atomic_store_explicit(&g_transport.position, blockStart + frameCount, memory_order_release);
+
+    // only bother the ui when there's something it would draw differently
+    uint64_t interval = atomic_load_explicit(&pEngine->notifyInterval, memory_order_relaxed);
+    bool moved = locate != NO_FRAME ||
+                 (rolling && interval > 0 && blockStart / interval != (blockStart + frameCount) / interval);
+    bool underrun = atomic_load_explicit(&g_player.underrunCount, memory_order_relaxed) != underrunsBefore;
+    bool overrun = atomic_load_explicit(&g_recorder.overrunCount, memory_order_relaxed) != overrunsBefore;
+    bool takeStarted = takeStartBefore != atomic_load_explicit(&g_recorder.startFrame, memory_order_relaxed);
+    if (moved || underrun || overrun || takeStarted) notify_ui(pEngine);
+
+    // what the device really asks for, which isn't always the period we negotiated
+    atomic_store_explicit(&pEngine->lastCallbackFrames, frameCount, memory_order_relaxed);
+    if (frameCount > atomic_load_explicit(&pEngine->maxCallbackFrames, memory_order_relaxed)) {
+        atomic_store_explicit(&pEngine->maxCallbackFrames, frameCount, memory_order_relaxed);
+    }
+
+    uint64_t callbackNs = now_ns() - callbackStart;
+    record_callback_time(&pEngine->telemetry, callbackNs, frameCount, underrun, overrun);
+    if (underrun) TRACE_COUNTER("underruns", atomic_load_explicit(&g_player.underrunCount, memory_order_relaxed));
+    if (overrun) TRACE_COUNTER("overruns", atomic_load_explicit(&g_recorder.overrunCount, memory_order_relaxed));
+    TRACE_COUNTER("callback us", callbackNs / 1000);
+    TRACE_END("callback");
+    atomic_fetch_add_explicit(&pEngine->callbackCount, 1, memory_order_release);
+}
+
+// blocks until the callback has started and finished at least one more period
+static void wait_for_callback()
+{
+    uint64_t seen = atomic_load_explicit(&g_engine.callbackCount, memory_order_acquire);
+    for (int i = 0; i < 200 && atomic_load_explicit(&g_engine.callbackCount, memory_order_acquire) < seen + 2; ++i) {
+        sleep_ms(1);
+    }
+}
+
+// moves everything that's in the ring into the encoder, in as few writes as possible
+static void drain_recording_ring(AudioRecorder* pRecorder)
+{
+    while (ma_pcm_rb_available_read(&pRecorder->ring) > 0) {
+        uint32_t frames = ma_pcm_rb_available_read(&pRecorder->ring);
+        void* pSrc;
+        if (ma_pcm_rb_acquire_read(&pRecorder->ring, &frames, &pSrc) != MA_SUCCESS || frames == 0) break;
+        TRACE_BEGIN("write take");
+        ma_encoder_write_pcm_frames(&pRecorder->encoder, pSrc, frames, NULL);
+        TRACE_END("write take");
+        ma_pcm_rb_commit_read(&pRecorder->ring, frames);
+        atomic_fetch_add_explicit(&pRecorder->framesWritten, frames, memory_order_relaxed);
+    }
+}
+
+static void* recording_writer_thread(void* pUserData)
+{
+    AudioRecorder* pRecorder = (AudioRecorder*)pUserData;
+    TRACE_THREAD_NAME("recording writer");
+
+    while (true) {
+        // read the flag before draining so the last frames the callback wrote still make it out
+        bool stopping = atomic_load(&pRecorder->stopWriter);
+        drain_recording_ring(pRecorder);
+        if (stopping) break;
+        sleep_ms(RECORD_WRITER_INTERVAL_MS);
+    }
+    return NULL;
+}
+
+// where the playhead is, or is about to be
+static uint64_t current_playhead()
+{
+    uint64_t locate = atomic_load_explicit(&g_transport.pendingLocate, memory_order_acquire);
+    return locate != NO_FRAME ? locate : atomic_load_explicit(&g_transport.position, memory_order_acquire);
+}
+
+// decodes straight into the ring until it's full or the segment is done
+static void fill_source_ring(PlaybackSource* pSource)
+{
+    while (!atomic_load_explicit(&pSource->eof, memory_order_relaxed)) {
+        uint32_t frames = ma_pcm_rb_available_write(&pSource->ring);
+        if (frames == 0) break;
+        if (pSource->endFrame - pSource->writeFrame < frames) frames = (uint32_t)(pSource->endFrame - pSource->writeFrame);
+
+        void* pDst;
+        if (ma_pcm_rb_acquire_write(&pSource->ring, &frames, &pDst) != MA_SUCCESS || frames == 0) break;
+        ma_uint64 got = 0;
+        TRACE_BEGIN("decode");
+        ma_decoder_read_pcm_frames(&pSource->decoder, pDst, frames, &got);
+        TRACE_END("decode");
+        ma_pcm_rb_commit_write(&pSource->ring, (uint32_t)got);
+        pSource->writeFrame += got;
+
+        if (got < frames || pSource->writeFrame >= pSource->endFrame) {
+            atomic_store_explicit(&pSource->eof, true, memory_order_release);
+        }
+    }
+}
+
+static bool open_source(PlaybackSource* pSource, uint64_t playhead, uint32_t readAheadFrames)
+{
+    ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, ENGINE_CHANNELS, ENGINE_SAMPLE_RATE);
+    if (ma_decoder_init_file(pSource->filePath, &decoderConfig, &pSource->decoder) != MA_SUCCESS) {
+        return false;
+    }
+    if (ma_pcm_rb_init(ma_format_f32, ENGINE_CHANNELS, readAheadFrames, NULL, NULL, &pSource->ring) != MA_SUCCESS) {
+        ma_decoder_uninit(&pSource->decoder);
+        return false;
+    }
+    pSource->hasResources = true;
+
+    pSource->writeFrame = pSource->startFrame > playhead ? pSource->startFrame : playhead;
+    uint64_t fileFrame = pSource->sourceOffset + (pSource->writeFrame - pSource->startFrame);
+    if (fileFrame > 0) {
+        ma_decoder_seek_to_pcm_frame(&pSource->decoder, fileFrame);
+    }
+    pSource->readFrame = pSource->writeFrame;
+    atomic_store(&pSource->eof, false);
+    fill_source_ring(pSource);
+    return true;
+}
+
+static void release_source(PlaybackSource* pSource)
+{
+    if (!pSource->hasResources) return;
+    ma_decoder_uninit(&pSource->decoder);
+    ma_pcm_rb_uninit(&pSource->ring);
+    pSource->hasResources = false;
+}
+
+// every reader looks after the slots with index % readerCount == its own index
+static void* disk_reader_thread(void* pUserData)
+{
+    uint32_t index = (uint32_t)(uintptr_t)pUserData;
+    TRACE_THREAD_NAME("disk reader");
+
+    while (!atomic_load(&g_engine.stopReaders)) {
+        uint64_t playhead = current_playhead();
+        uint32_t highWater = atomic_load_explicit(&g_player.sourceHighWater, memory_order_acquire);
+
+        for (uint32_t i = index; i < highWater; i += g_engine.readerCount) {
+            PlaybackSource* pSource = &g_player.sources[i];
+            int state = atomic_load_explicit(&pSource->state, memory_order_acquire);
+
+            if (state == SOURCE_QUEUED) {
+                // only open what's about to be heard, rings cost memory
+                if (pSource->startFrame >= playhead + g_player.readAheadFrames) continue;
+                TRACE_BEGIN("open source");
+                bool opened = pSource->endFrame > playhead && open_source(pSource, playhead, g_player.readAheadFrames);
+                TRACE_END("open source");
+                if (!opened) {
+                    release_source(pSource);
+                    int expected = SOURCE_QUEUED;
+                    atomic_compare_exchange_strong(&pSource->state, &expected, SOURCE_FINISHED);
+                    continue;
+                }
+                int expected = SOURCE_QUEUED;
+                if (!atomic_compare_exchange_strong_explicit(&pSource->state, &expected, SOURCE_READY,
+                                                             memory_order_acq_rel, memory_order_acquire)) {
+                    // got detached while we were opening it, the DETACHED case cleans up
+                    continue;
+                }
+            } else if (state == SOURCE_READY) {
+                fill_source_ring(pSource);
+            } else if (state == SOURCE_FINISHED) {
+                release_source(pSource);
+            } else if (state == SOURCE_DETACHED) {
+                release_source(pSource);
+                free(pSource->filePath);
+                pSource->filePath = NULL;
+                atomic_store_explicit(&pSource->state, SOURCE_FREE, memory_order_release);
+            }
+        }
+        sleep_ms(READER_INTERVAL_MS);
     }
-    
-    (void)pOutput;
+    return NULL;
 }
 
-ma_result start_recording(const char* outputFilePath, ma_format format, uint32_t channels, uint32_t sampleRate)
+AudioEngineConfig audio_engine_config_init()
+{
+    AudioEngineConfig config;
+    config.readAheadMs = 2000;
+    config.readerThreads = 1;
+    config.periodSizeInFrames = 0;
+    config.periods = 0;
+    config.nullBackend = false;
+    return config;
+}
+
+ma_result open_audio_devices(const AudioEngineConfig* pConfig)
 {
     ma_result result;
-    
-    if (g_recorder.isInitialized) {
-        printf("Already initialized. Stop current recording first.\n");
-        return MA_INVALID_OPERATION;
+
+    if (g_engine.isOpen) return MA_SUCCESS;
+
+    AudioEngineConfig config = pConfig != NULL ? *pConfig : audio_engine_config_init();
+    if (config.readerThreads < 1) config.readerThreads = 1;
+    if (config.readerThreads > MAX_READER_THREADS) config.readerThreads = MAX_READER_THREADS;
+    // the ring has to hold at least a couple of periods
+    g_player.readAheadFrames = (uint32_t)((uint64_t)config.readAheadMs * ENGINE_SAMPLE_RATE / 1000);
+    if (g_player.readAheadFrames < ENGINE_SAMPLE_RATE / 10) g_player.readAheadFrames = ENGINE_SAMPLE_RATE / 10;
+    if (g_player.readAheadFrames < config.periodSizeInFrames * 4) g_player.readAheadFrames = config.periodSizeInFrames * 4;
+
+    g_player.sources = (PlaybackSource*)calloc(MAX_PLAYBACK_SOURCES, sizeof(PlaybackSource));
+    if (g_player.sources == NULL) {
+        return MA_OUT_OF_MEMORY;
+    }
+    atomic_store(&g_player.sourceHighWater, 0);
+    atomic_store(&g_transport.position, 0);
+    atomic_store(&g_transport.pendingLocate, NO_FRAME);
+    atomic_store(&g_transport.rolling, false);
+    atomic_store(&g_player.underrunFrames, 0);
+    atomic_store(&g_player.underrunCount, 0);
+
+    g_recorder.ringCapacity = ENGINE_SAMPLE_RATE * RECORD_RING_SECONDS;
+    result = ma_pcm_rb_init(RECORD_FORMAT, ENGINE_CHANNELS, g_recorder.ringCapacity, NULL, NULL, &g_recorder.ring);
+    if (result != MA_SUCCESS) {
+        free(g_player.sources);
+        g_player.sources = NULL;
+        return result;
     }
-    
-    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_capture);
-    deviceConfig.capture.format   = format;
-    deviceConfig.capture.channels = channels;
-    deviceConfig.sampleRate       = sampleRate;
-    deviceConfig.dataCallback     = data_callback;
-    deviceConfig.pUserData        = &g_recorder;
 
-    result = ma_device_init(NULL, &deviceConfig, &g_recorder.device);
+    // duplex keeps capture and playback on the same clock, fall back to output only
+    // on machines without an input
+    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_duplex);
+    deviceConfig.capture.format    = RECORD_FORMAT;
+    deviceConfig.capture.channels  = ENGINE_CHANNELS;
+    deviceConfig.playback.format   = ma_format_f32;
+    deviceConfig.playback.channels = ENGINE_CHANNELS;
+    deviceConfig.sampleRate        = ENGINE_SAMPLE_RATE;
+    deviceConfig.dataCallback      = engine_callback;
+    deviceConfig.pUserData         = &g_engine;
+    // 0 leaves it up to miniaudio/the backend
+    deviceConfig.periodSizeInFrames = config.periodSizeInFrames;
+    deviceConfig.periods            = config.periods;
+
+    // NULL is the default context, which picks whatever backend works on this machine
+    ma_context* pContext = NULL;
+    g_engine.hasContext = false;
+    if (config.nullBackend) {
+        ma_backend backends[] = {ma_backend_null};
+        result = ma_context_init(backends, 1, NULL, &g_engine.context);
+        if (result != MA_SUCCESS) {
+            ma_pcm_rb_uninit(&g_recorder.ring);
+            free(g_player.sources);
+            g_player.sources = NULL;
+            return result;
+        }
+        g_engine.hasContext = true;
+        pContext = &g_engine.context;
+    }
+
+    g_engine.hasCapture = true;
+    result = ma_device_init(pContext, &deviceConfig, &g_engine.device);
+    if (result != MA_SUCCESS) {
+        deviceConfig.deviceType = ma_device_type_playback;
+        g_engine.hasCapture = false;
+        result = ma_device_init(pContext, &deviceConfig, &g_engine.device);
+    }
+    if (result != MA_SUCCESS) {
+        if (g_engine.hasContext) ma_context_uninit(&g_engine.context);
+        g_engine.hasContext = false;
+        ma_pcm_rb_uninit(&g_recorder.ring);
+        free(g_player.sources);
+        g_player.sources = NULL;
+        return result;
+    }
+
+    // no callback yet, so nobody else is writing
+    clear_telemetry(&g_engine.telemetry);
+    atomic_store(&g_engine.telemetry.resetRequested, false);
+    // everything the callback and the readers look at is set up before either of them runs
+    g_engine.requestedPeriodFrames = config.periodSizeInFrames;
+    atomic_store(&g_engine.lastCallbackFrames, 0);
+    atomic_store(&g_engine.maxCallbackFrames, 0);
+    g_engine.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    atomic_store(&g_engine.notifyPending, false);
+    atomic_store(&g_engine.notifyInterval, 0);
+
+    // readerCount is every reader's stride, so it has to be final before the first
+    // one starts. if one can't be started, the others are stopped and it's tried with fewer
+    uint32_t readers = config.readerThreads;
+    while (readers > 0) {
+        g_engine.readerCount = readers;
+        atomic_store(&g_engine.stopReaders, false);
+        uint32_t started = 0;
+        while (started < readers &&
+               pthread_create(&g_engine.readers[started], NULL, disk_reader_thread, (void*)(uintptr_t)started) == 0) {
+            started++;
+        }
+        if (started == readers) break;
+        atomic_store(&g_engine.stopReaders, true);
+        for (uint32_t i = 0; i < started; ++i) pthread_join(g_engine.readers[i], NULL);
+        readers = started;
+    }
+    g_engine.readerCount = readers;
+
+    result = g_engine.readerCount > 0 ? ma_device_start(&g_engine.device) : MA_ERROR;
     if (result != MA_SUCCESS) {
-        printf("Failed to initialize capture device: %d\n", result);
+        atomic_store(&g_engine.stopReaders, true);
+        for (uint32_t i = 0; i < g_engine.readerCount; ++i) pthread_join(g_engine.readers[i], NULL);
+        if (g_engine.eventFd >= 0) close(g_engine.eventFd);
+        g_engine.eventFd = -1;
+        ma_device_uninit(&g_engine.device);
+        if (g_engine.hasContext) ma_context_uninit(&g_engine.context);
+        g_engine.hasContext = false;
+        ma_pcm_rb_uninit(&g_recorder.ring);
+        free(g_player.sources);
+        g_player.sources = NULL;
         return result;
     }
-    
+
+    g_engine.isOpen = true;
+    return MA_SUCCESS;
+}
+
+void close_audio_devices()
+{
+    if (!g_engine.isOpen) return;
+
+    if (g_recorder.isInitialized) stop_recording();
+    atomic_store(&g_transport.rolling, false);
+
+    ma_device_uninit(&g_engine.device);
+    if (g_engine.hasContext) ma_context_uninit(&g_engine.context);
+    g_engine.hasContext = false;
+    if (g_engine.eventFd >= 0) close(g_engine.eventFd);
+    g_engine.eventFd = -1;
+    g_engine.isOpen = false;
+
+    atomic_store(&g_engine.stopReaders, true);
+    for (uint32_t i = 0; i < g_engine.readerCount; ++i) pthread_join(g_engine.readers[i], NULL);
+
+    // callback and readers are gone, everything can be freed directly
+    for (uint32_t i = 0; i < MAX_PLAYBACK_SOURCES; ++i) {
+        release_source(&g_player.sources[i]);
+        free(g_player.sources[i].filePath);
+    }
+    free(g_player.sources);
+    g_player.sources = NULL;
+    ma_pcm_rb_uninit(&g_recorder.ring);
+}
+
+ma_result start_recording(const char* outputFilePath)
+{
+    ma_result result;
+
+    if (g_recorder.isInitialized) {
+        return MA_INVALID_OPERATION;
+    }
+    if (!g_engine.isOpen || !g_engine.hasCapture) {
+        return MA_INVALID_OPERATION;
+    }
+
     ma_encoder_config encoderConfig = ma_encoder_config_init(
         ma_encoding_format_wav,
-        format,
-        channels,
-        sampleRate
+        RECORD_FORMAT,
+        ENGINE_CHANNELS,
+        ENGINE_SAMPLE_RATE
     );
-    
+
     result = ma_encoder_init_file(outputFilePath, &encoderConfig, &g_recorder.encoder);
     if (result != MA_SUCCESS) {
-        printf("Failed to initialize encoder: %d\n", result);
-        ma_device_uninit(&g_recorder.device);
         return result;
     }
-    
-    result = ma_device_start(&g_recorder.device);
-    if (result != MA_SUCCESS) {
-        printf("Failed to start device: %d\n", result);
+
+    // nobody is touching the ring while we're not recording
+    ma_pcm_rb_reset(&g_recorder.ring);
+    atomic_store(&g_recorder.stopWriter, false);
+    atomic_store(&g_recorder.framesCaptured, 0);
+    atomic_store(&g_recorder.framesWritten, 0);
+    atomic_store(&g_recorder.overrunFrames, 0);
+    atomic_store(&g_recorder.overrunCount, 0);
+    atomic_store(&g_recorder.startFrame, NO_FRAME);
+    if (pthread_create(&g_recorder.writer, NULL, recording_writer_thread, &g_recorder) != 0) {
         ma_encoder_uninit(&g_recorder.encoder);
-        ma_device_uninit(&g_recorder.device);
-        return result;
+        return MA_ERROR;
     }
-    
-    g_recorder.isRecording = MA_TRUE;
+
+    atomic_store_explicit(&g_recorder.isRecording, true, memory_order_release);
     g_recorder.isInitialized = MA_TRUE;
-    
-    printf("Recording started to: %s\n", outputFilePath);
+
     return MA_SUCCESS;
 }
 
 ma_result stop_recording()
 {
     if (!g_recorder.isInitialized) {
-        printf("No active recording to stop.\n");
         return MA_INVALID_OPERATION;
     }
-    
-    g_recorder.isRecording = MA_FALSE;
-    
-    ma_device_stop(&g_recorder.device);
-    ma_device_uninit(&g_recorder.device);
-    
+
+    atomic_store_explicit(&g_recorder.isRecording, false, memory_order_release);
+    TRACE_BEGIN("stop_recording");
+
+    // let a callback that's already past the check finish its write, then have
+    // the writer flush the rest of the ring and exit
+    wait_for_callback();
+    atomic_store(&g_recorder.stopWriter, true);
+    pthread_join(g_recorder.writer, NULL);
+
     ma_encoder_uninit(&g_recorder.encoder);
-    
+
     g_recorder.isInitialized = MA_FALSE;
-    
-    printf("Recording stopped and saved.\n");
+    TRACE_END("stop_recording");
+
     return MA_SUCCESS;
 }
 
-typedef struct {
-    ma_device device;
-    ma_decoder decoder;
-    bool isPlaying;
-    bool isInitialized;
-} AudioPlayer;
+void get_recording_stats(RecordingStats* pStats)
+{
+    pStats->framesCaptured = atomic_load_explicit(&g_recorder.framesCaptured, memory_order_relaxed);
+    pStats->framesWritten  = atomic_load_explicit(&g_recorder.framesWritten, memory_order_relaxed);
+    pStats->overrunFrames  = atomic_load_explicit(&g_recorder.overrunFrames, memory_order_relaxed);
+    pStats->overrunCount   = (uint32_t)atomic_load_explicit(&g_recorder.overrunCount, memory_order_relaxed);
+    pStats->ringCapacity   = g_recorder.ringCapacity;
+    pStats->ringFill       = g_recorder.isInitialized ? ma_pcm_rb_available_read(&g_recorder.ring) : 0;
+    pStats->startFrame     = atomic_load_explicit(&g_recorder.startFrame, memory_order_relaxed);
+}
 
-static AudioPlayer g_player = {0};
+static double buffer_latency_ms(uint32_t periodSize, uint32_t periods, uint32_t sampleRate)
+{
+    return sampleRate > 0 ? 1000.0 * periodSize * periods / sampleRate : 0.0;
+}
 
-void playback_callback(ma_device* pDevice, void* pOutput, const void* pInput, uint32_t frameCount)
+void get_latency_info(LatencyInfo* pInfo)
 {
-    (void)pDevice;
-    (void)pInput;
-    if (!g_player.isInitialized) return;
-    ma_decoder_read_pcm_frames(&g_player.decoder, pOutput, frameCount, NULL);
+    memset(pInfo, 0, sizeof(*pInfo));
+    if (!g_engine.isOpen) return;
+
+    const ma_device* pDevice = &g_engine.device;
+    pInfo->requestedPeriodFrames = g_engine.requestedPeriodFrames;
+    pInfo->playbackPeriodFrames  = pDevice->playback.internalPeriodSizeInFrames;
+    pInfo->playbackPeriods       = pDevice->playback.internalPeriods;
+    pInfo->outputLatencyMs = buffer_latency_ms(pDevice->playback.internalPeriodSizeInFrames,
+                                               pDevice->playback.internalPeriods, pDevice->playback.internalSampleRate);
+    if (g_engine.hasCapture) {
+        pInfo->capturePeriodFrames = pDevice->capture.internalPeriodSizeInFrames;
+        pInfo->capturePeriods      = pDevice->capture.internalPeriods;
+        pInfo->inputLatencyMs = buffer_latency_ms(pDevice->capture.internalPeriodSizeInFrames,
+                                                  pDevice->capture.internalPeriods, pDevice->capture.internalSampleRate);
+    }
+    pInfo->lastCallbackFrames = atomic_load_explicit(&g_engine.lastCallbackFrames, memory_order_relaxed);
+    pInfo->maxCallbackFrames  = atomic_load_explicit(&g_engine.maxCallbackFrames, memory_order_relaxed);
 }
 
-ma_result stop_playback()
+void get_callback_timing(CallbackTiming* pTiming)
 {
-    if (!g_player.isInitialized) {
-        return MA_INVALID_OPERATION;
+    CallbackTelemetry* pTelemetry = &g_engine.telemetry;
+    while (true) {
+        // odd means the callback is halfway through, it's never long
+        unsigned seq = atomic_load_explicit(&pTelemetry->seq, memory_order_acquire);
+        if (seq & 1) continue;
+        pTiming->callbacks     = atomic_load_explicit(&pTelemetry->callbacks, memory_order_relaxed);
+        pTiming->lateCallbacks = atomic_load_explicit(&pTelemetry->lateCallbacks, memory_order_relaxed);
+        pTiming->totalNs       = atomic_load_explicit(&pTelemetry->totalNs, memory_order_relaxed);
+        pTiming->maxNs         = atomic_load_explicit(&pTelemetry->maxNs, memory_order_relaxed);
+        pTiming->lastNs        = atomic_load_explicit(&pTelemetry->lastNs, memory_order_relaxed);
+        pTiming->totalFrames   = atomic_load_explicit(&pTelemetry->totalFrames, memory_order_relaxed);
+        pTiming->underruns     = atomic_load_explicit(&pTelemetry->underruns, memory_order_relaxed);
+        pTiming->overruns      = atomic_load_explicit(&pTelemetry->overruns, memory_order_relaxed);
+        for (int i = 0; i < CALLBACK_LOAD_BUCKETS; ++i) {
+            pTiming->loadHistogram[i] = (uint32_t)atomic_load_explicit(&pTelemetry->loadHistogram[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&pTelemetry->seq, memory_order_relaxed) == seq) return;
     }
+}
 
-    g_player.isPlaying = false;
+void reset_callback_timing()
+{
+    atomic_store_explicit(&g_engine.telemetry.resetRequested, true, memory_order_release);
+}
 
-    ma_device_stop(&g_player.device);
-    ma_device_uninit(&g_player.device);
-    ma_decoder_uninit(&g_player.decoder);
+double callback_load_percentile(const CallbackTiming* pTiming, double fraction)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < CALLBACK_LOAD_BUCKETS; ++i) total += pTiming->loadHistogram[i];
+    if (total == 0) return 0.0;
+    uint64_t want = (uint64_t)(fraction * total + 0.5);
+    uint64_t seen = 0;
+    for (int i = 0; i < CALLBACK_LOAD_BUCKETS; ++i) {
+        seen += pTiming->loadHistogram[i];
+        if (seen >= want) return i;
+    }
+    return CALLBACK_LOAD_BUCKETS - 1;
+}
 
-    g_player.isInitialized = false;
-    printf("Playback stopped.\n");
-    return MA_SUCCESS;
+bool dump_engine_telemetry(const char* path)
+{
+    if (!g_engine.isOpen) return false;
+    FILE* pFile = fopen(path, "w");
+    if (pFile == NULL) return false;
+
+    CallbackTiming timing;
+    LatencyInfo latency;
+    PlaybackStats playback;
+    get_callback_timing(&timing);
+    get_latency_info(&latency);
+    get_playback_stats(&playback);
+
+    double periodNs = timing.totalFrames * 1e9 / ENGINE_SAMPLE_RATE;
+    fprintf(pFile, "{\n");
+    fprintf(pFile, "  \"device\": {\"requested_period\": %u, \"playback_period\": %u, \"playback_periods\": %u, "
+                   "\"capture_period\": %u, \"capture_periods\": %u, \"max_callback_frames\": %u, "
+                   "\"output_latency_ms\": %.2f, \"input_latency_ms\": %.2f},\n",
+            latency.requestedPeriodFrames, latency.playbackPeriodFrames, latency.playbackPeriods,
+            latency.capturePeriodFrames, latency.capturePeriods, latency.maxCallbackFrames,
+            latency.outputLatencyMs, latency.inputLatencyMs);
+    fprintf(pFile, "  \"callbacks\": %llu,\n  \"late_callbacks\": %llu,\n  \"mean_us\": %.2f,\n  \"max_us\": %.2f,\n",
+            (unsigned long long)timing.callbacks, (unsigned long long)timing.lateCallbacks,
+            timing.callbacks ? timing.totalNs / 1e3 / timing.callbacks : 0.0, timing.maxNs / 1e3);
+    fprintf(pFile, "  \"dsp_load\": %.2f,\n  \"load_p50\": %.0f,\n  \"load_p99\": %.0f,\n  \"load_p999\": %.0f,\n",
+            periodNs > 0 ? 100.0 * timing.totalNs / periodNs : 0.0, callback_load_percentile(&timing, 0.5),
+            callback_load_percentile(&timing, 0.99), callback_load_percentile(&timing, 0.999));
+    fprintf(pFile, "  \"underrun_periods\": %llu,\n  \"overrun_periods\": %llu,\n  \"underrun_frames\": %llu,\n",
+            (unsigned long long)timing.underruns, (unsigned long long)timing.overruns,
+            (unsigned long long)playback.underrunFrames);
+    // sparse, percent of the period -> callbacks
+    fprintf(pFile, "  \"load_histogram\": {");
+    bool first = true;
+    for (int i = 0; i < CALLBACK_LOAD_BUCKETS; ++i) {
+        if (timing.loadHistogram[i] == 0) continue;
+        fprintf(pFile, "%s\"%d\": %u", first ? "" : ", ", i, timing.loadHistogram[i]);
+        first = false;
+    }
+    fprintf(pFile, "}\n}\n");
+    return fclose(pFile) == 0;
 }
 
-ma_result start_playback(const char* inputFilePath)
+int get_engine_event_fd()
 {
-    ma_result result;
+    return g_engine.isOpen ? g_engine.eventFd : -1;
+}
+
+void set_engine_notify_interval(uint64_t frames)
+{
+    atomic_store_explicit(&g_engine.notifyInterval, frames, memory_order_relaxed);
+}
+
+void clear_engine_events()
+{
+    if (!g_engine.isOpen || g_engine.eventFd < 0) return;
+    uint64_t count;
+    ssize_t got = read(g_engine.eventFd, &count, sizeof(count));
+    (void)got;
+    // cleared after the read, the ui reads the engine state after this anyway
+    atomic_store_explicit(&g_engine.notifyPending, false, memory_order_release);
+}
+
+uint64_t get_transport_position()
+{
+    return current_playhead();
+}
+
+bool transport_is_rolling()
+{
+    return atomic_load_explicit(&g_transport.rolling, memory_order_acquire);
+}
+
+void transport_start(uint64_t fromFrame)
+{
+    if (transport_is_rolling()) return;
+    atomic_store_explicit(&g_transport.pendingLocate, fromFrame, memory_order_release);
+    atomic_store_explicit(&g_transport.rolling, true, memory_order_release);
+}
+
+void transport_stop()
+{
+    atomic_store_explicit(&g_transport.rolling, false, memory_order_release);
+}
 
-    if (g_player.isInitialized) {
-        stop_playback();
+void transport_locate(uint64_t frame)
+{
+    atomic_store_explicit(&g_transport.pendingLocate, frame, memory_order_release);
+}
+
+void get_playback_stats(PlaybackStats* pStats)
+{
+    pStats->underrunFrames = atomic_load_explicit(&g_player.underrunFrames, memory_order_relaxed);
+    pStats->underrunCount  = (uint32_t)atomic_load_explicit(&g_player.underrunCount, memory_order_relaxed);
+    pStats->readAheadFrames = g_player.readAheadFrames;
+    pStats->queuedSources = 0;
+    pStats->streamingSources = 0;
+    pStats->minBufferedFrames = 0;
+
+    if (!g_engine.isOpen) return;
+    bool first = true;
+    uint32_t highWater = atomic_load(&g_player.sourceHighWater);
+    for (uint32_t i = 0; i < highWater; ++i) {
+        PlaybackSource* pSource = &g_player.sources[i];
+        int state = atomic_load(&pSource->state);
+        if (state == SOURCE_QUEUED) pStats->queuedSources++;
+        if (state != SOURCE_READY) continue;
+        // only the ring's read/write pointers are touched here, that's safe from any thread
+        uint32_t buffered = ma_pcm_rb_available_read(&pSource->ring);
+        if (first || buffered < pStats->minBufferedFrames) pStats->minBufferedFrames = buffered;
+        first = false;
+        pStats->streamingSources++;
     }
+}
 
-    result = ma_decoder_init_file(inputFilePath, NULL, &g_player.decoder);
-    if (result != MA_SUCCESS) {
-        printf("Failed to init decoder: %d\n", result);
-        return result;
+int attach_playback_source(const PlaybackSegment* pSegment, uint64_t fromFrame)
+{
+    if (!g_engine.isOpen) return -1;
+
+    uint64_t endFrame = pSegment->startFrame + pSegment->frameCount;
+    if (pSegment->frameCount == 0 || endFrame <= fromFrame) return -1;
+
+    int id = -1;
+    for (int i = 0; i < MAX_PLAYBACK_SOURCES; ++i) {
+        int expected = SOURCE_FREE;
+        if (atomic_compare_exchange_strong(&g_player.sources[i].state, &expected, SOURCE_LOADING)) {
+            id = i;
+            break;
+        }
     }
+    // all slots taken
+    if (id < 0) return -1;
 
-    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
-    deviceConfig.playback.format   = g_player.decoder.outputFormat;
-    deviceConfig.playback.channels = g_player.decoder.outputChannels;
-    deviceConfig.sampleRate        = g_player.decoder.outputSampleRate;
-    deviceConfig.dataCallback      = playback_callback;
-    deviceConfig.pUserData         = &g_player;
+    // no file io here, a disk reader opens it once the playhead gets close
+    PlaybackSource* pSource = &g_player.sources[id];
+    pSource->filePath = strdup(pSegment->filePath);
+    pSource->startFrame = pSegment->startFrame;
+    pSource->endFrame = endFrame;
+    pSource->sourceOffset = pSegment->sourceOffset;
+    atomic_store(&pSource->eof, false);
 
-    result = ma_device_init(NULL, &deviceConfig, &g_player.device);
-    if (result != MA_SUCCESS) {
-        printf("Failed to initialize playback device: %d\n", result);
-        ma_decoder_uninit(&g_player.decoder);
-        return result;
+    if ((uint32_t)id >= atomic_load(&g_player.sourceHighWater)) {
+        atomic_store_explicit(&g_player.sourceHighWater, (uint32_t)id + 1, memory_order_release);
     }
+    atomic_store_explicit(&pSource->state, SOURCE_QUEUED, memory_order_release);
+    return id;
+}
 
-    result = ma_device_start(&g_player.device);
-    if (result != MA_SUCCESS) {
-        printf("Failed to start playback device: %d\n", result);
-        ma_device_uninit(&g_player.device);
-        ma_decoder_uninit(&g_player.decoder);
-        return result;
+void detach_playback_source(int sourceId)
+{
+    if (sourceId < 0 || sourceId >= MAX_PLAYBACK_SOURCES || g_player.sources == NULL) return;
+    atomic_int* pState = &g_player.sources[sourceId].state;
+    int state = atomic_load(pState);
+    while (state == SOURCE_QUEUED || state == SOURCE_READY || state == SOURCE_FINISHED) {
+        if (atomic_compare_exchange_weak(pState, &state, SOURCE_DETACHING)) break;
+    }
+}
+
+// gives the readers a moment to buffer whatever plays right at fromFrame
+static void wait_for_sources_primed(uint64_t fromFrame)
+{
+    for (int waited = 0; waited < PRIME_TIMEOUT_MS; waited += READER_INTERVAL_MS) {
+        bool primed = true;
+        uint32_t highWater = atomic_load(&g_player.sourceHighWater);
+        for (uint32_t i = 0; i < highWater && primed; ++i) {
+            PlaybackSource* pSource = &g_player.sources[i];
+            if (atomic_load(&pSource->state) != SOURCE_QUEUED) continue;
+            if (pSource->startFrame < fromFrame + g_player.readAheadFrames / 2) primed = false;
+        }
+        if (primed) return;
+        sleep_ms(READER_INTERVAL_MS);
+    }
+}
+
+ma_result stop_playback()
+{
+    if (!g_engine.isOpen) {
+        return MA_INVALID_OPERATION;
+    }
+
+    // the device keeps running, it just goes quiet and lets go of the sources.
+    // a take that's still recording keeps the transport rolling
+    if (!atomic_load(&g_recorder.isRecording)) transport_stop();
+    uint32_t highWater = atomic_load(&g_player.sourceHighWater);
+    for (uint32_t i = 0; i < highWater; ++i) {
+        detach_playback_source((int)i);
+    }
+    return MA_SUCCESS;
+}
+
+ma_result start_playback(const PlaybackSegment* pSegments, uint32_t segmentCount, uint64_t fromFrame, int* pSourceIds)
+{
+    if (!g_engine.isOpen) {
+        return MA_INVALID_OPERATION;
+    }
+
+    stop_playback();
+
+    // joining a transport that's already rolling (recording) picks up where it is
+    bool rolling = transport_is_rolling();
+    if (rolling) {
+        fromFrame = get_transport_position();
+    } else {
+        transport_locate(fromFrame);
     }
 
-    g_player.isPlaying = true;
-    g_player.isInitialized = true;
+    for (uint32_t i = 0; i < segmentCount; ++i) {
+        int id = attach_playback_source(&pSegments[i], fromFrame);
+        if (pSourceIds) pSourceIds[i] = id;
+    }
 
-    printf("Playback started: %s\n", inputFilePath);
+    if (!rolling) {
+        TRACE_BEGIN("prime sources");
+        wait_for_sources_primed(fromFrame);
+        TRACE_END("prime sources");
+        transport_start(fromFrame);
+    }
     return MA_SUCCESS;
 }
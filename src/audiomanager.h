@@ -1,19 +1,151 @@
 #pragma once
 #include "dependencies/miniaudio.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 // to ensure C compatability
 extern "C" {
 #endif
 
-ma_result start_recording(const char* outputFilePath, ma_format format, uint32_t channels, uint32_t sampleRate);
+// the engine always runs at this format, takes get converted while decoding
+#define ENGINE_SAMPLE_RATE 44100
+#define ENGINE_CHANNELS 2
+// recordings are written like this
+#define RECORD_FORMAT ma_format_s16
+// how many segments can be attached to the playback engine at once
+#define MAX_PLAYBACK_SOURCES 512
+#define MAX_READER_THREADS 8
+
+typedef struct {
+    uint32_t readAheadMs;    // how far ahead of the playhead the disk readers keep every source buffered
+    uint32_t readerThreads;  // disk reader threads feeding the playback sources
+    uint32_t periodSizeInFrames; // the session's buffer length, 0 lets the backend pick
+    uint32_t periods;            // periods in the device buffer, 0 lets the backend pick
+    bool nullBackend;            // run on miniaudio's null backend instead of real hardware (silent input,
+                                 // output goes nowhere, still clocked like a device). for tests and benchmarks
+} AudioEngineConfig;
+
+AudioEngineConfig audio_engine_config_init();
+
+// nothing in here prints, the ui owns the terminal. everything that can fail says
+// so through its return value.
+//
+// opens the audio device(s) once for the whole DAW session and keeps them running.
+// transport and recording only flip state on the running device after this.
+// pConfig can be NULL for the defaults.
+ma_result open_audio_devices(const AudioEngineConfig* pConfig);
+void close_audio_devices();
+
+// what the device actually gave us. the latencies are how much audio sits in the
+// device buffers (period size * periods), the callback sizes are what the
+// backend really asked for since the device was opened.
+typedef struct {
+    uint32_t requestedPeriodFrames;
+    uint32_t playbackPeriodFrames;
+    uint32_t playbackPeriods;
+    uint32_t capturePeriodFrames;
+    uint32_t capturePeriods;
+    uint32_t lastCallbackFrames;
+    uint32_t maxCallbackFrames;
+    double outputLatencyMs;
+    double inputLatencyMs;
+} LatencyInfo;
+
+void get_latency_info(LatencyInfo* pInfo);
+
+// what the callback has been up to since the device opened (or the last reset).
+// the callback publishes it through a seqlock, so a reader always gets one
+// consistent snapshot and the callback never waits for a reader. loadHistogram[i]
+// counts the callbacks that used i% of their period (the time they had), the
+// last bucket also gets everything slower than that
+#define CALLBACK_LOAD_BUCKETS 201
+
+typedef struct {
+    uint64_t callbacks;
+    uint64_t lateCallbacks;  // took longer than their period, a real device would have glitched
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t lastNs;
+    uint64_t totalFrames;    // frames the timed callbacks were asked for
+    uint64_t underruns;      // periods where a playback source wasn't buffered in time
+    uint64_t overruns;       // periods where the capture ring was full and input got dropped
+    uint32_t loadHistogram[CALLBACK_LOAD_BUCKETS];
+} CallbackTiming;
+
+void get_callback_timing(CallbackTiming* pTiming);
+// the callback clears everything at the start of its next period
+void reset_callback_timing();
+// load (percent of the period) that the given fraction of callbacks stayed under
+double callback_load_percentile(const CallbackTiming* pTiming, double fraction);
+// writes the timing along with the device's latency and the xrun counts as json,
+// for tuning the buffer length on a machine
+bool dump_engine_telemetry(const char* path);
+
+// an eventfd the ui can poll on instead of waking up on a timer. the callback
+// signals it when the playhead crosses a multiple of the notify interval, on a
+// locate, on any xrun and when a take starts. clear_engine_events() rearms it.
+int get_engine_event_fd();
+void set_engine_notify_interval(uint64_t frames);
+void clear_engine_events();
+
+// the transport clock counts sample frames and is only ever advanced by the
+// audio callback. locate/start are applied at the start of the next period.
+uint64_t get_transport_position();
+bool transport_is_rolling();
+void transport_start(uint64_t fromFrame); // does nothing if it's already rolling
+void transport_stop();
+void transport_locate(uint64_t frame);
+
+// what the capture ring has been up to during the current/last recording
+typedef struct {
+    uint64_t framesCaptured;  // frames the callback got into the ring
+    uint64_t framesWritten;   // frames the writer thread got into the file
+    uint64_t overrunFrames;   // frames dropped because the ring was full
+    uint32_t overrunCount;    // callbacks that had to drop anything
+    uint32_t ringFill;        // frames waiting to be written right now
+    uint32_t ringCapacity;
+    uint64_t startFrame;      // transport frame the take starts at (UINT64_MAX until the first callback)
+} RecordingStats;
+
+ma_result start_recording(const char* outputFilePath);
 ma_result stop_recording();
+void get_recording_stats(RecordingStats* pStats);
+
+// a piece of a take placed on the timeline, in sample frames
+typedef struct {
+    const char* filePath;
+    uint64_t startFrame;
+    uint64_t frameCount;
+    uint64_t sourceOffset; // where in the file the segment starts (at the engine rate)
+} PlaybackSegment;
 
-ma_result start_playback(const char* inputFilePath);
+// attach/detach single segments while the device is running. attach returns the
+// slot id (or -1) and never touches the disk, a reader thread opens the file once
+// the playhead gets within the read-ahead. detach is picked up on the next period.
+int attach_playback_source(const PlaybackSegment* pSegment, uint64_t fromFrame);
+void detach_playback_source(int sourceId);
+
+// how well the disk readers are keeping up
+typedef struct {
+    uint64_t underrunFrames;     // frames that played as silence because a source wasn't buffered
+    uint32_t underrunCount;      // periods that had any of those
+    uint32_t queuedSources;      // attached but not opened yet (still too far ahead)
+    uint32_t streamingSources;   // opened and being read ahead
+    uint32_t minBufferedFrames;  // fill of the emptiest source ring
+    uint32_t readAheadFrames;
+} PlaybackStats;
+
+void get_playback_stats(PlaybackStats* pStats);
+
+// plays the given segments mixed together, starting at fromFrame. more can be
+// attached while it plays, pSourceIds (can be NULL) gets the slot id of each
+// segment or -1. if the transport is already rolling (recording) playback joins
+// at the current position. stop_playback stops the transport too, unless a take
+// is still recording.
+ma_result start_playback(const PlaybackSegment* pSegments, uint32_t segmentCount, uint64_t fromFrame, int* pSourceIds);
 ma_result stop_playback();
 
 #ifdef __cplusplus
 }
 #endif
-
@@ -38,8 +38,12 @@ void showMainMenu() {
                 choice = (choice + 1) % num_options;
                 break;
             case '\n':
-                if (options[choice] == "Start New Session") {
-                    showNewSessionScreen();
+                if (options[choice] == "Start New Session" || options[choice] == "Load Session") {
+                    if (options[choice] == "Start New Session") {
+                        showNewSessionScreen();
+                    } else {
+                        showLoadSessionScreen();
+                    }
                     clear();
                     printw("Welcome to CLIWave!\n");
                     printw("Use arrow keys to navigate. Press Enter to select.\n\n");
@@ -77,7 +81,11 @@ void showMainMenu() {
     }
 }
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "render") {
+        return runRenderCommand(argc - 2, argv + 2);
+    }
+
     initscr();
     cbreak();
     noecho();
@@ -8,5 +8,9 @@
 
 void showMainMenu();
 void showNewSessionScreen();
+void showLoadSessionScreen();
 void showEditSessionScreen(char* sessionName, char* sessionLength, char* bufferLength, char* recordDir, char* exportDir);
-void showDAWInterface(char* sessionName, char* sessionLength, char* bufferLength, char* recordDir, char* exportDir);
\ No newline at end of file
+void showDAWInterface(char* sessionName, char* sessionLength, char* bufferLength, char* recordDir, char* exportDir);
+
+// headless, "cliwave render ..." goes straight here and never starts ncurses
+int runRenderCommand(int argc, char** argv);
@@ -0,0 +1,257 @@
+#include "dawscreen.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+// "Timeline: |" and "[Track 1] |" are both this wide, cells start right after
+static const int kLabelWidth = 11;
+static const int kControlRows = 19;
+
+static const char* kControls[] = {
+    "Controls:",
+    "  Space   - Play/Pause",
+    "  R       - Record",
+    "  S       - Stop",
+    "  Up/Down - Select track",
+    "  Left/Right - Move playhead (PgUp/PgDn a page, Home/End)",
+    "  [ / ]   - Zoom out/in",
+    "  M       - Mute selected track",
+    "  E       - Export mixdown in the background (16-bit)",
+    "  F       - Export mixdown as 32-bit float",
+    "  X       - Export from the playhead to the end",
+    "  C       - Cancel the newest export",
+    "  W       - Save session now (edits are autosaved)",
+    "  T       - Engine stats (saved to the record dir on quit)",
+    "  P       - Write a trace now (tracing builds, also on quit)",
+    "  +/-     - Add/Remove track",
+    "  Ctrl-L  - Redraw the screen",
+    "  Q       - Quit to menu",
+};
+
+DawScreen::~DawScreen() {
+    destroyWindows();
+}
+
+void DawScreen::invalidate() {
+    needsLayout = true;
+    // curses only knows what it drew itself, this repaints every cell on the next update
+    clearok(curscr, TRUE);
+}
+
+void DawScreen::destroyWindows() {
+    for (WINDOW** win : {&statusWin, &rulerWin, &tracksWin, &controlsWin}) {
+        if (*win) delwin(*win);
+        *win = nullptr;
+    }
+}
+
+// windows that would start below the terminal aren't created at all
+static WINDOW* makeWindow(int rows, int y) {
+    if (y >= LINES || COLS <= 0) return nullptr;
+    return newwin(std::min(rows, LINES - y), COLS, y, 0);
+}
+
+int DawScreen::timelineCells() const {
+    // whatever doesn't fit next to the label and the closing '|' is cut off
+    return std::max(0, COLS - kLabelWidth - 1);
+}
+
+int DawScreen::visibleCells(const DawView& view) const {
+    // a short session (or the end of a long one) doesn't fill the whole width
+    uint64_t left = view.sessionCells > view.viewStartCell ? view.sessionCells - view.viewStartCell : 0;
+    return (int)std::min<uint64_t>(timelineCells(), left);
+}
+
+// ruler label for a session position. the closer labels are together the
+// finer it gets, down to plain sample numbers
+static std::string rulerLabel(uint64_t frame, uint64_t labelStep, uint32_t sampleRate) {
+    char text[32];
+    uint64_t seconds = frame / sampleRate;
+    if (labelStep >= sampleRate) {
+        snprintf(text, sizeof(text), "%llu:%02llu", (unsigned long long)(seconds / 60), (unsigned long long)(seconds % 60));
+    } else if (labelStep * 1000 >= sampleRate) {
+        unsigned ms = (unsigned)((frame % sampleRate) * 1000 / sampleRate);
+        snprintf(text, sizeof(text), "%llu:%02llu.%03u", (unsigned long long)(seconds / 60), (unsigned long long)(seconds % 60), ms);
+    } else {
+        snprintf(text, sizeof(text), "%llu", (unsigned long long)frame);
+    }
+    return text;
+}
+
+void DawScreen::layout(const DawView& view) {
+    destroyWindows();
+
+    // blank stdscr once so nothing from the previous screen shows between the windows
+    werase(stdscr);
+    wnoutrefresh(stdscr);
+
+    int numTracks = (int)view.lanes.size();
+    int y = 0;
+    statusWin = makeWindow((int)view.status.size() + 1, y);
+    y += (int)view.status.size() + 1;
+    rulerWin = makeWindow(3, y);
+    y += 3;
+    tracksWin = makeWindow(numTracks + 3, y);
+    y += numTracks + 3;
+    controlsWin = makeWindow(kControlRows, y);
+
+    layoutLines = LINES;
+    layoutCols = COLS;
+    layoutTracks = numTracks;
+    layoutStatus = (int)view.status.size();
+    needsLayout = false;
+
+    // forget what was shown, everything gets drawn from scratch below
+    shownStatus.assign(view.status.size(), StatusLine{std::string(), A_NORMAL});
+    shownViewStart = UINT64_MAX;
+    shownPlayhead = -1;
+    shownSelected = -1;
+    shownLanes.assign(numTracks, std::string());
+
+    drawControls();
+    if (tracksWin) {
+        mvwprintw(tracksWin, 0, 0, "Tracks:");
+        for (int i = 0; i < numTracks; i++) mvwprintw(tracksWin, i + 1, 0, "[Track %d] |", i + 1);
+        wnoutrefresh(tracksWin);
+    }
+}
+
+// the ruler (and the track frame, which is as wide) only changes when the view
+// scrolls or zooms. ticks every 5 session cells, a label every 10
+bool DawScreen::drawRuler(const DawView& view) {
+    if (!rulerWin) return false;
+    if (view.viewStartCell == shownViewStart && view.framesPerCell == shownZoom &&
+        view.sessionCells == shownSessionCells) {
+        return false;
+    }
+
+    int cells = visibleCells(view);
+    uint64_t labelStep = view.framesPerCell * 10;
+    std::string ruler(cells, ' ');
+    std::string timeline(cells, '-');
+    int labelEnd = 0;
+    for (int i = 0; i < cells; i++) {
+        uint64_t cell = view.viewStartCell + i;
+        if (cell % 5 == 0) timeline[i] = '|';
+        if (cell % 10 != 0 || i < labelEnd) continue;
+        std::string label = rulerLabel(cell * view.framesPerCell, labelStep, view.sampleRate);
+        // labels that would run into the next one are left out
+        for (size_t c = 0; c < label.size() && i + (int)c < cells; c++) ruler[i + c] = label[c];
+        labelEnd = i + (int)label.size() + 1;
+    }
+
+    werase(rulerWin);
+    mvwprintw(rulerWin, 0, 0, "Time:     |");
+    waddstr(rulerWin, ruler.c_str());
+    waddch(rulerWin, '|');
+    mvwprintw(rulerWin, 1, 0, "Timeline: |");
+    waddstr(rulerWin, timeline.c_str());
+    waddch(rulerWin, '|');
+
+    // the closing '|' of every lane moves with the right end of the view
+    if (tracksWin) {
+        int numTracks = (int)view.lanes.size();
+        for (int t = 0; t < numTracks; t++) {
+            wmove(tracksWin, t + 1, kLabelWidth);
+            wclrtoeol(tracksWin);
+            mvwaddch(tracksWin, t + 1, kLabelWidth + cells, '|');
+            shownLanes[t].assign(cells, ' ');
+        }
+        std::string trackLine(kLabelWidth + cells + 1, '-');
+        wmove(tracksWin, numTracks + 2, 0);
+        wclrtoeol(tracksWin);
+        waddnstr(tracksWin, trackLine.c_str(), COLS);
+        wnoutrefresh(tracksWin);
+    }
+
+    shownViewStart = view.viewStartCell;
+    shownZoom = view.framesPerCell;
+    shownSessionCells = view.sessionCells;
+    // the playhead got wiped with the rest of the row
+    shownPlayhead = -1;
+    return true;
+}
+
+void DawScreen::drawControls() {
+    if (!controlsWin) return;
+    for (int i = 0; i < (int)(sizeof(kControls) / sizeof(kControls[0])); i++) {
+        mvwaddnstr(controlsWin, i + 1, 0, kControls[i], COLS);
+    }
+    wnoutrefresh(controlsWin);
+}
+
+bool DawScreen::drawStatus(const DawView& view) {
+    if (!statusWin) return false;
+    bool changed = false;
+    for (size_t i = 0; i < view.status.size(); i++) {
+        const StatusLine& line = view.status[i];
+        if (line.text == shownStatus[i].text && line.attr == shownStatus[i].attr) continue;
+        wmove(statusWin, (int)i, 0);
+        wclrtoeol(statusWin);
+        wattron(statusWin, line.attr);
+        waddnstr(statusWin, line.text.c_str(), COLS);
+        wattroff(statusWin, line.attr);
+        shownStatus[i] = line;
+        changed = true;
+    }
+    return changed;
+}
+
+bool DawScreen::drawTimeline(const DawView& view) {
+    if (!rulerWin || view.playhead == shownPlayhead) return false;
+    int cells = visibleCells(view);
+
+    // put back the cell the playhead was on and draw it on the new one
+    if (shownPlayhead >= 0 && shownPlayhead < cells) {
+        uint64_t cell = view.viewStartCell + shownPlayhead;
+        mvwaddch(rulerWin, 1, kLabelWidth + shownPlayhead, cell % 5 == 0 ? '|' : '-');
+    }
+    if (view.playhead >= 0 && view.playhead < cells) {
+        mvwaddch(rulerWin, 1, kLabelWidth + view.playhead, '>' | A_REVERSE);
+    }
+    shownPlayhead = view.playhead;
+    return true;
+}
+
+bool DawScreen::drawTracks(const DawView& view) {
+    if (!tracksWin) return false;
+    bool changed = false;
+    int cells = visibleCells(view);
+    const auto& lanes = view.lanes;
+
+    if (view.selectedTrack != shownSelected) {
+        for (int t : {shownSelected, view.selectedTrack}) {
+            if (t < 0 || t >= (int)lanes.size()) continue;
+            if (t == view.selectedTrack) wattron(tracksWin, A_REVERSE);
+            mvwprintw(tracksWin, t + 1, 0, "[Track %d]", t + 1);
+            if (t == view.selectedTrack) wattroff(tracksWin, A_REVERSE);
+        }
+        shownSelected = view.selectedTrack;
+        changed = true;
+    }
+
+    for (size_t t = 0; t < lanes.size(); t++) {
+        for (int j = 0; j < cells && j < (int)lanes[t].size() && j < (int)shownLanes[t].size(); j++) {
+            if (lanes[t][j] == shownLanes[t][j]) continue;
+            mvwaddch(tracksWin, (int)t + 1, kLabelWidth + j, lanes[t][j]);
+            shownLanes[t][j] = lanes[t][j];
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void DawScreen::draw(const DawView& view) {
+    if (needsLayout || LINES != layoutLines || COLS != layoutCols || (int)view.lanes.size() != layoutTracks ||
+        (int)view.status.size() != layoutStatus) {
+        layout(view);
+    }
+
+    if (drawStatus(view)) wnoutrefresh(statusWin);
+    bool rulerChanged = drawRuler(view);
+    if (drawTimeline(view) || rulerChanged) wnoutrefresh(rulerWin);
+    if (drawTracks(view)) wnoutrefresh(tracksWin);
+
+    // only sends what the wnoutrefresh calls above marked, nothing when idle
+    doupdate();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <ncurses.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// one row of the status area at the top of the DAW screen
+struct StatusLine {
+    std::string text;
+    attr_t attr;
+};
+
+// everything the DAW screen shows in one frame. the timeline is a window onto
+// the session: only the cells that fit on the terminal are ever in here
+struct DawView {
+    std::vector<StatusLine> status;
+    uint64_t viewStartCell;  // session cell shown in the leftmost column
+    uint64_t framesPerCell;  // zoom, how many sample frames one cell covers
+    uint64_t sessionCells;   // cells the whole session takes at this zoom
+    uint32_t sampleRate;
+    int playhead;            // column the playhead is on, -1 when it's scrolled out of view
+    int selectedTrack;
+    std::vector<std::string> lanes; // the visible cells of each track
+};
+
+// draws the DAW screen into a few ncurses windows and keeps a copy of what's
+// already on the terminal, so a frame only rewrites the cells that changed and
+// doupdate() only has to send those.
+class DawScreen {
+public:
+    ~DawScreen();
+
+    void draw(const DawView& view);
+    // the next draw repaints everything (terminal resized, came back from another screen,
+    // something other than curses wrote to the terminal)
+    void invalidate();
+    // how many timeline cells fit next to the track labels right now
+    int timelineCells() const;
+
+private:
+    void layout(const DawView& view);
+    void destroyWindows();
+    bool drawStatus(const DawView& view);
+    bool drawRuler(const DawView& view);
+    bool drawTimeline(const DawView& view);
+    bool drawTracks(const DawView& view);
+    void drawControls();
+    int visibleCells(const DawView& view) const;
+
+    WINDOW* statusWin = nullptr;
+    WINDOW* rulerWin = nullptr;
+    WINDOW* tracksWin = nullptr;
+    WINDOW* controlsWin = nullptr;
+
+    // what the windows currently hold
+    bool needsLayout = true;
+    int layoutLines = -1;
+    int layoutCols = -1;
+    int layoutTracks = -1;
+    int layoutStatus = -1;
+    std::vector<StatusLine> shownStatus;
+    uint64_t shownViewStart = UINT64_MAX;
+    uint64_t shownZoom = 0;
+    uint64_t shownSessionCells = 0;
+    int shownPlayhead = -1;
+    int shownSelected = -1;
+    std::vector<std::string> shownLanes;
+};
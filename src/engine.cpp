@@ -0,0 +1,109 @@
+#include "engine.hpp"
+
+bool loadSession(const std::string& path, SessionData& session, std::string& error, size_t* journalEdits) {
+    SessionFile file;
+    if (!file.open(path)) {
+        error = file.error();
+        return false;
+    }
+    session = SessionData();
+    file.load(session);
+    // the file has its paths relative to where it is, the engine wants them relative to here
+    for (auto& track : session.tracks) {
+        for (auto& seg : track) seg.filename = resolveSessionPath(seg.filename, path);
+    }
+    // a session file always lives in its record directory
+    session.recordDir = resolveSessionPath(".", path);
+    session.exportDir = resolveSessionPath(session.exportDir, path);
+    // whatever was edited after the last snapshot (or before a crash) is in the journal
+    size_t edits = replayJournal(SessionJournal::journalPathFor(path), session);
+    if (journalEdits) *journalEdits = edits;
+    return true;
+}
+
+// where a segment sits on the timeline
+static uint64_t segmentStartFrame(const Segment& seg) {
+    return (uint64_t)seg.startFrame;
+}
+
+static uint64_t segmentEndFrame(const Segment& seg) {
+    return (uint64_t)(seg.startFrame + seg.frameCount);
+}
+
+IntervalIndex indexTrack(const std::vector<Segment>& segments) {
+    std::vector<IntervalIndex::Span> spans;
+    spans.reserve(segments.size());
+    for (size_t i = 0; i < segments.size(); i++) {
+        const Segment& seg = segments[i];
+        if (seg.frameCount <= 0 || seg.startFrame < 0 || seg.sourceOffset < 0) continue;
+        spans.push_back({segmentStartFrame(seg), segmentEndFrame(seg), (uint32_t)i});
+    }
+    IntervalIndex index;
+    index.assign(std::move(spans));
+    return index;
+}
+
+// how far ahead segments get attached, the readers still only open what's within
+// their read-ahead. the extra second covers the ui only looking every 250 ms
+static uint64_t playbackLookahead() {
+    PlaybackStats stats;
+    get_playback_stats(&stats);
+    return (uint64_t)stats.readAheadFrames * 2 + ENGINE_SAMPLE_RATE;
+}
+
+static PlaybackSegment toPlaybackSegment(const Segment& seg) {
+    PlaybackSegment ps;
+    ps.filePath = seg.filename.c_str();
+    ps.startFrame = segmentStartFrame(seg);
+    ps.frameCount = segmentEndFrame(seg) - ps.startFrame;
+    ps.sourceOffset = (uint64_t)seg.sourceOffset;
+    return ps;
+}
+
+ma_result startSessionPlayback(PlaybackWindow& window, const std::vector<std::vector<Segment>>& trackSegments,
+                               const std::vector<IntervalIndex>& trackIndex, uint64_t fromFrame) {
+    window.attached.clear();
+    std::vector<PlaybackSegment> segments;
+    std::vector<std::pair<size_t, uint32_t>> keys;
+    uint64_t lookahead = playbackLookahead();
+    for (size_t t = 0; t < trackIndex.size(); t++) {
+        trackIndex[t].overlapping(fromFrame, fromFrame + lookahead, [&](const IntervalIndex::Span& span) {
+            segments.push_back(toPlaybackSegment(trackSegments[t][span.id]));
+            keys.push_back({t, span.id});
+        });
+    }
+    std::vector<int> ids(segments.size(), -1);
+    ma_result res = start_playback(segments.data(), (uint32_t)segments.size(), fromFrame, ids.data());
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (ids[i] >= 0) window.attached[keys[i]] = ids[i];
+    }
+    return res;
+}
+
+void updateSessionPlayback(PlaybackWindow& window, const std::vector<std::vector<Segment>>& trackSegments,
+                           const std::vector<IntervalIndex>& trackIndex, uint64_t playhead) {
+    for (auto it = window.attached.begin(); it != window.attached.end();) {
+        size_t t = it->first.first;
+        uint32_t s = it->first.second;
+        bool gone = t >= trackSegments.size() || s >= trackSegments[t].size() ||
+                    segmentEndFrame(trackSegments[t][s]) <= playhead;
+        if (gone) {
+            detach_playback_source(it->second);
+            it = window.attached.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    uint64_t lookahead = playbackLookahead();
+    for (size_t t = 0; t < trackIndex.size(); t++) {
+        trackIndex[t].overlapping(playhead, playhead + lookahead, [&](const IntervalIndex::Span& span) {
+            std::pair<size_t, uint32_t> key(t, span.id);
+            if (window.attached.count(key)) return;
+            PlaybackSegment ps = toPlaybackSegment(trackSegments[t][span.id]);
+            // a full engine just means trying again on the next update
+            int id = attach_playback_source(&ps, playhead);
+            if (id >= 0) window.attached[key] = id;
+        });
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// everything in libcliwave_engine, none of it touches ncurses. a front-end (the
+// tui, the render command, a benchmark) only needs this header:
+//   session   - SessionFile/SessionData/writeSessionFile, SessionJournal, loadSession below
+//   transport - transport_start/stop/locate and friends in audiomanager.h
+//   playback  - the session playback window below, on top of attach/detach_playback_source
+//   record    - start_recording/stop_recording in audiomanager.h
+//   render    - mixdownTracks, offline and faster than realtime, ExportQueue runs them in the background
+//   peaks     - PeakCache for drawing waveforms
+//   kernels   - the simd mix loops in mixkernels.h
+//   tracing   - trace.h, compiled in with -DCLIWAVE_TRACE=ON
+#include "audiomanager.h"
+#include "exportqueue.hpp"
+#include "intervalindex.hpp"
+#include "mixdown.hpp"
+#include "mixkernels.h"
+#include "peaks.hpp"
+#include "sessionfile.hpp"
+#include "sessionjournal.hpp"
+#include "trace.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// opens a .cws snapshot and replays whatever its journal has on top of it.
+// journalEdits (can be null) gets how many edits came from the journal
+bool loadSession(const std::string& path, SessionData& session, std::string& error, size_t* journalEdits = nullptr);
+
+// a track's segments by timeline span, rebuild it whenever the track changes
+IntervalIndex indexTrack(const std::vector<Segment>& segments);
+
+// only the segments near the playhead are attached to the engine, so a session
+// with thousands of them never runs out of playback slots
+struct PlaybackWindow {
+    std::map<std::pair<size_t, uint32_t>, int> attached; // (track, segment) -> engine source id
+};
+
+// starts the engine with whatever overlaps the first stretch from the playhead
+ma_result startSessionPlayback(PlaybackWindow& window, const std::vector<std::vector<Segment>>& trackSegments,
+                               const std::vector<IntervalIndex>& trackIndex, uint64_t fromFrame);
+// call as the playhead moves: lets go of what it's past and attaches what's coming up
+void updateSessionPlayback(PlaybackWindow& window, const std::vector<std::vector<Segment>>& trackSegments,
+                           const std::vector<IntervalIndex>& trackIndex, uint64_t playhead);
@@ -0,0 +1,212 @@
+#include "exportqueue.hpp"
+#include "audiomanager.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+ExportQueue::ExportQueue(unsigned threadBudget, unsigned maxJobThreads) {
+    if (threadBudget == 0) threadBudget = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    budget = threadBudget;
+    maxPerJob = maxJobThreads ? std::min(maxJobThreads, budget) : (budget + 1) / 2;
+    notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+ExportQueue::~ExportQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (auto& entry : entries) {
+            if (entry->job.state == State::Queued) entry->job.state = State::Cancelled;
+            entry->progress.cancel = true;
+        }
+    }
+    // nothing starts anymore and nothing gets removed, the list can be walked without the lock
+    for (auto& entry : entries) {
+        if (entry->thread.joinable()) entry->thread.join();
+    }
+    if (notifyFd >= 0) close(notifyFd);
+}
+
+int ExportQueue::submit(const std::vector<std::vector<Segment>>& trackSegments, int64_t sessionFrames,
+                        const std::string& exportPath, MixdownFormat format, int64_t startFrame, int64_t endFrame) {
+    std::unique_ptr<Entry> entry(new Entry());
+    entry->tracks = trackSegments;
+    entry->sessionFrames = sessionFrames;
+    entry->job.path = exportPath;
+    entry->job.format = format;
+    entry->job.endFrame = endFrame < 0 ? sessionFrames : std::min(endFrame, sessionFrames);
+    entry->job.startFrame = std::min(std::max<int64_t>(startFrame, 0), std::max<int64_t>(entry->job.endFrame, 0));
+    entry->job.etaSeconds = -1.0;
+
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // two jobs writing the same file would make a mess of it
+        for (const auto& other : entries) {
+            if (other->job.path == exportPath &&
+                (other->job.state == State::Queued || other->job.state == State::Running)) {
+                return -1;
+            }
+        }
+        id = entry->job.id = nextId++;
+        entries.push_back(std::move(entry));
+        startJobs();
+    }
+    notify();
+    return id;
+}
+
+bool ExportQueue::cancel(int id) {
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& entry : entries) {
+            if (entry->job.id != id) continue;
+            if (entry->job.state == State::Queued) {
+                entry->job.state = State::Cancelled;
+                found = true;
+            } else if (entry->job.state == State::Running) {
+                // the job notices between two blocks of the mix and finishes as cancelled
+                entry->progress.cancel = true;
+                found = true;
+            }
+        }
+    }
+    if (found) notify();
+    return found;
+}
+
+int ExportQueue::newestActive() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        const Entry& entry = **it;
+        if ((entry.job.state == State::Queued || entry.job.state == State::Running) && !entry.progress.cancel) {
+            return entry.job.id;
+        }
+    }
+    return -1;
+}
+
+void ExportQueue::startJobs() {
+    if (stopping) return;
+    unsigned waiting = 0;
+    for (const auto& entry : entries) {
+        if (entry->job.state == State::Queued) waiting++;
+    }
+
+    for (auto& entry : entries) {
+        if (entry->job.state != State::Queued) continue;
+        unsigned free = budget > threadsInUse ? budget - threadsInUse : 0;
+        if (free == 0) break;
+        // whatever is free gets split between everything that's waiting
+        unsigned threads = std::min(maxPerJob, std::max(1u, free / waiting));
+        waiting--;
+        threadsInUse += threads;
+        entry->job.threads = threads;
+        entry->job.state = State::Running;
+        entry->started = std::chrono::steady_clock::now();
+        entry->thread = std::thread(&ExportQueue::runJob, this, entry.get());
+    }
+}
+
+void ExportQueue::runJob(Entry* pEntry) {
+    TRACE_THREAD_NAME("export job");
+    // nothing below changes once the job is running, only state and the times do
+    MixdownOptions options;
+    options.startFrame = pEntry->job.startFrame;
+    options.endFrame = pEntry->job.endFrame;
+    options.format = pEntry->job.format;
+    options.threads = pEntry->job.threads;
+    options.pProgress = &pEntry->progress;
+
+    TRACE_BEGIN("export");
+    bool ok = mixdownTracks(pEntry->tracks, pEntry->sessionFrames, pEntry->job.path, options);
+    TRACE_END("export");
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pEntry->job.elapsedSeconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - pEntry->started).count();
+        if (ok) {
+            pEntry->job.state = State::Done;
+        } else {
+            pEntry->job.state = pEntry->progress.cancel ? State::Cancelled : State::Failed;
+        }
+        // the tracks can be big, the job is only kept around for its numbers now
+        std::vector<std::vector<Segment>>().swap(pEntry->tracks);
+        threadsInUse -= pEntry->job.threads;
+        startJobs();
+    }
+    notify();
+}
+
+ExportQueue::Job ExportQueue::snapshot(const Entry& entry) const {
+    Job job = entry.job;
+    if (job.state == State::Running) {
+        job.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - entry.started).count();
+    }
+    uint64_t total = entry.progress.totalFrames.load(std::memory_order_relaxed);
+    uint64_t done = entry.progress.framesDone.load(std::memory_order_relaxed);
+    job.progress = job.state == State::Done ? 1.0 : (total > 0 ? double(done) / total : 0.0);
+
+    double audioSeconds = double(job.endFrame - job.startFrame) / ENGINE_SAMPLE_RATE;
+    if (job.elapsedSeconds > 0.0) job.realtime = audioSeconds * job.progress / job.elapsedSeconds;
+    // the first few percent are mostly opening decoders, too early to guess from
+    job.etaSeconds = -1.0;
+    if (job.state == State::Running && job.progress >= 0.02) {
+        job.etaSeconds = job.elapsedSeconds * (1.0 - job.progress) / job.progress;
+    }
+    return job;
+}
+
+std::vector<ExportQueue::Job> ExportQueue::jobs() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Job> result;
+    for (const auto& entry : entries) result.push_back(snapshot(*entry));
+    return result;
+}
+
+std::vector<ExportQueue::Job> ExportQueue::takeFinished() {
+    std::vector<Job> result;
+    std::vector<std::unique_ptr<Entry>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = entries.begin(); it != entries.end();) {
+            State state = (*it)->job.state;
+            if (state == State::Queued || state == State::Running) {
+                ++it;
+                continue;
+            }
+            result.push_back(snapshot(**it));
+            finished.push_back(std::move(*it));
+            it = entries.erase(it);
+        }
+    }
+    // the job's thread is already past everything that touches the entry
+    for (auto& entry : finished) {
+        if (entry->thread.joinable()) entry->thread.join();
+    }
+    return result;
+}
+
+bool ExportQueue::busy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : entries) {
+        if (entry->job.state == State::Queued || entry->job.state == State::Running) return true;
+    }
+    return false;
+}
+
+void ExportQueue::notify() {
+    uint64_t one = 1;
+    ssize_t written = write(notifyFd, &one, sizeof(one));
+    (void)written;
+}
+
+void ExportQueue::clearEvents() {
+    uint64_t count;
+    ssize_t got = read(notifyFd, &count, sizeof(count));
+    (void)got;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "mixdown.hpp"
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// runs mixdowns in the background so the DAW screen never waits on one. jobs
+// start in the order they were queued while the thread budget has room, each
+// one takes its share of the free threads (never more than maxJobThreads, so a
+// second export doesn't have to wait for the first one to finish)
+class ExportQueue {
+public:
+    enum class State { Queued, Running, Done, Failed, Cancelled };
+
+    // a snapshot of one job, for drawing
+    struct Job {
+        int id = 0;
+        std::string path;
+        MixdownFormat format = MixdownFormat::S16;
+        int64_t startFrame = 0;
+        int64_t endFrame = 0;
+        State state = State::Queued;
+        unsigned threads = 0;
+        double progress = 0.0;       // 0..1 over both passes
+        double elapsedSeconds = 0.0; // since it started running
+        double realtime = 0.0;       // seconds of audio done per second, so far
+        double etaSeconds = 0.0;     // -1 until there's enough to go by
+    };
+
+    // threadBudget = 0 leaves one core for the audio callback and the ui and takes
+    // the rest, maxJobThreads = 0 is half the budget (rounded up)
+    explicit ExportQueue(unsigned threadBudget = 0, unsigned maxJobThreads = 0);
+    // cancels whatever is still queued or running and waits for it
+    ~ExportQueue();
+
+    // copies the tracks, so the session can keep changing while it runs. returns
+    // the job id, or -1 if the same file is already queued or being written
+    int submit(const std::vector<std::vector<Segment>>& trackSegments, int64_t sessionFrames, const std::string& exportPath,
+               MixdownFormat format, int64_t startFrame = 0, int64_t endFrame = -1);
+    // false if there's no such job or it's already finished
+    bool cancel(int id);
+    // the newest job that hasn't finished, -1 if there's none
+    int newestActive();
+
+    // everything queued, running or finished since the last takeFinished(), oldest first
+    std::vector<Job> jobs();
+    // hands back the finished jobs and forgets them
+    std::vector<Job> takeFinished();
+    bool busy();
+
+    // readable whenever a job started or finished since clearEvents()
+    int eventFd() const { return notifyFd; }
+    void clearEvents();
+    unsigned threadBudget() const { return budget; }
+
+private:
+    struct Entry {
+        Job job;
+        std::vector<std::vector<Segment>> tracks;
+        int64_t sessionFrames = 0;
+        MixdownProgress progress;
+        std::chrono::steady_clock::time_point started;
+        std::thread thread;
+    };
+
+    void startJobs(); // with the mutex held
+    void runJob(Entry* pEntry);
+    Job snapshot(const Entry& entry) const;
+    void notify();
+
+    std::mutex mutex;
+    std::list<std::unique_ptr<Entry>> entries;
+    unsigned budget;
+    unsigned maxPerJob;
+    unsigned threadsInUse = 0;
+    int nextId = 1;
+    bool stopping = false;
+    int notifyFd = -1;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// a static interval tree over [start, end) spans. the spans are sorted by start
+// and the sorted array doubles as an implicit balanced tree (the middle of every
+// range is its root), with the max end of each subtree kept next to it. asking
+// what overlaps [from, to) skips every subtree that ends before from or starts
+// after to, so it costs O(log n + k) and the spans come out sorted by start.
+class IntervalIndex {
+public:
+    struct Span {
+        uint64_t start;
+        uint64_t end;
+        uint32_t id; // whatever the caller wants back, usually an index into its own array
+    };
+
+    void assign(std::vector<Span> newSpans) {
+        spans = std::move(newSpans);
+        std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.start < b.start; });
+        maxEnd.assign(spans.size(), 0);
+        buildMaxEnd(0, spans.size());
+    }
+
+    size_t size() const { return spans.size(); }
+
+    // calls fn(span) for every span overlapping [from, to), in start order
+    template <typename Fn>
+    void overlapping(uint64_t from, uint64_t to, Fn fn) const {
+        if (from < to) visit(0, spans.size(), from, to, fn);
+    }
+
+private:
+    uint64_t buildMaxEnd(size_t lo, size_t hi) {
+        if (lo >= hi) return 0;
+        size_t mid = lo + (hi - lo) / 2;
+        uint64_t end = std::max(spans[mid].end, std::max(buildMaxEnd(lo, mid), buildMaxEnd(mid + 1, hi)));
+        maxEnd[mid] = end;
+        return end;
+    }
+
+    template <typename Fn>
+    void visit(size_t lo, size_t hi, uint64_t from, uint64_t to, Fn& fn) const {
+        if (lo >= hi) return;
+        size_t mid = lo + (hi - lo) / 2;
+        // nothing under here reaches from
+        if (maxEnd[mid] <= from) return;
+        visit(lo, mid, from, to, fn);
+        // everything from mid on starts too late
+        if (spans[mid].start >= to) return;
+        if (spans[mid].end > from) fn(spans[mid]);
+        visit(mid + 1, hi, from, to, fn);
+    }
+
+    std::vector<Span> spans;
+    std::vector<uint64_t> maxEnd;
+};
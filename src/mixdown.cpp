@@ -0,0 +1,464 @@
+#include "mixdown.hpp"
+#include "audiomanager.h"
+#include "mixkernels.h"
+#include "intervalindex.hpp"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+
+// the mixdown walks the timeline in fixed blocks so memory stays the same
+// no matter how long the session is (used to allocate the whole mix bus up front)
+static const ma_uint32 kMixBlockFrames = 4096;
+
+// the export threads go through the timeline together, a round of blocks at a
+// time. every track is rendered into its own bus by whichever thread picks it
+// up, and its decoders keep running from one round to the next (reopening or
+// seeking a decoder that resamples lands a fraction of a sample off). the buses
+// are then added up in track order, so the file comes out bit-identical whatever
+// the thread count
+static const ma_uint32 kMixBlocksPerRound = 4;
+static const ma_uint64 kMixRoundFrames = (ma_uint64)kMixBlockFrames * kMixBlocksPerRound;
+
+// one per segment, the decoder is only open while the segment overlaps the block being rendered
+struct MixSource {
+    ma_uint64 startFrame;
+    ma_uint64 endFrame;
+    ma_uint64 sourceOffset;
+    const std::string* filename;
+    ma_decoder decoder;
+    ma_uint64 cursor; // timeline frame the decoder hands out next
+    bool open;
+    bool done;
+};
+
+// where the time of one export thread went, only filled in when someone asked for MixdownStats
+struct MixTimes {
+    double decode = 0.0;
+    double mix = 0.0;
+    double normalize = 0.0;
+    uint64_t decodedFrames = 0;
+};
+
+static double mixClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// one track's sources and its bus for the current round
+struct MixTrack {
+    std::vector<MixSource> sources;
+    IntervalIndex index;
+    std::vector<float> bus;
+    bool silent; // nothing of the track in this round, bus is left as it was
+};
+
+// the sources are placed relative to rangeStart, a segment that starts before it
+// is cut so it starts right at the beginning of the export
+static void buildMixTrack(const std::vector<Segment>& segments, ma_uint64 rangeStart, ma_uint64 totalFrames, MixTrack& track) {
+    // sized once up front, an initialized ma_decoder must not move around in memory
+    track.sources.clear();
+    track.sources.reserve(segments.size());
+    for (const auto& seg : segments) {
+        if (seg.frameCount <= 0 || seg.startFrame < 0 || seg.sourceOffset < 0) continue;
+        ma_uint64 segStart = (ma_uint64)seg.startFrame;
+        ma_uint64 segEnd = segStart + (ma_uint64)seg.frameCount;
+        ma_uint64 offset = (ma_uint64)seg.sourceOffset;
+        if (segEnd <= rangeStart) continue;
+        if (segStart < rangeStart) {
+            offset += rangeStart - segStart;
+            segStart = rangeStart;
+        }
+        MixSource src = {};
+        src.startFrame = segStart - rangeStart;
+        src.endFrame = segEnd - rangeStart;
+        src.sourceOffset = offset;
+        if (src.endFrame > totalFrames) src.endFrame = totalFrames;
+        if (src.startFrame >= src.endFrame) continue;
+        src.filename = &seg.filename;
+        track.sources.push_back(src);
+    }
+
+    std::vector<IntervalIndex::Span> spans(track.sources.size());
+    for (size_t i = 0; i < track.sources.size(); i++) {
+        spans[i] = {track.sources[i].startFrame, track.sources[i].endFrame, (uint32_t)i};
+    }
+    track.index.assign(std::move(spans));
+    track.silent = true;
+}
+
+static void closeMixSource(MixSource& src) {
+    if (src.open) ma_decoder_uninit(&src.decoder);
+    src.open = false;
+    src.done = true;
+}
+
+// renders frames [blockStart, blockStart + frameCount) of one track into out (interleaved).
+// only the sources the index says overlap the block are looked at. scratch has to
+// hold at least frameCount * channels floats. times (can be null) gets the decode
+// and mix time added to it. false if nothing played in the block
+static bool renderMixBlock(std::vector<MixSource>& sources, const IntervalIndex& index, ma_uint64 blockStart,
+                           ma_uint32 frameCount, int channels, int sampleRate, float* out, float* scratch, MixTimes* times) {
+    std::fill(out, out + (size_t)frameCount * channels, 0.0f);
+    ma_uint64 blockEnd = blockStart + frameCount;
+    bool mixed = false;
+
+    index.overlapping(blockStart, blockEnd, [&](const IntervalIndex::Span& span) {
+        MixSource& src = sources[span.id];
+        if (src.done) return;
+        double started = times ? mixClock() : 0.0;
+
+        if (!src.open) {
+            // always decode to f32 at the session rate, whatever the take was recorded as
+            ma_decoder_config decCfg = ma_decoder_config_init(ma_format_f32, channels, sampleRate);
+            if (ma_decoder_init_file(src.filename->c_str(), &decCfg, &src.decoder) != MA_SUCCESS) {
+                src.done = true;
+                return;
+            }
+            src.open = true;
+            // a fresh decoder is at the start of the file, which is sourceOffset
+            // frames before the segment (wraps around for a trimmed one, still never == from)
+            src.cursor = src.startFrame - src.sourceOffset;
+        }
+
+        ma_uint64 from = std::max(src.startFrame, blockStart);
+        ma_uint64 to = std::min(src.endFrame, blockEnd);
+        if (src.cursor != from) {
+            ma_decoder_seek_to_pcm_frame(&src.decoder, from - src.startFrame + src.sourceOffset);
+            src.cursor = from;
+        }
+
+        ma_uint64 got = 0;
+        TRACE_BEGIN("decode");
+        ma_decoder_read_pcm_frames(&src.decoder, scratch, to - from, &got);
+        TRACE_END("decode");
+        src.cursor += got;
+        mixed = mixed || got > 0;
+
+        double decoded = times ? mixClock() : 0.0;
+        mix_accumulate(out + (size_t)(from - blockStart) * channels, scratch, (size_t)got * channels);
+        if (times) {
+            times->decode += decoded - started;
+            times->mix += mixClock() - decoded;
+            times->decodedFrames += got;
+        }
+
+        // finished (or the file ran out early), release the decoder right away
+        if (got < to - from || to == src.endFrame) {
+            closeMixSource(src);
+        }
+    });
+    return mixed;
+}
+
+// what one export thread keeps to itself
+struct MixWorker {
+    std::vector<float> scratch;
+    float peak;
+    bool timed;
+    MixTimes times;
+};
+
+// the export threads, started once for the whole mixdown. run(fn) calls
+// fn(worker) on every one of them (worker 0 is the calling thread) and returns
+// once they're all done
+class MixPool {
+public:
+    explicit MixPool(unsigned threads) : count(threads) {
+        for (unsigned w = 1; w < count; ++w) pool.emplace_back(&MixPool::loop, this, w);
+    }
+
+    ~MixPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : pool) t.join();
+    }
+
+    void run(const std::function<void(unsigned)>& fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pTask = &fn;
+            busy = count - 1;
+            generation++;
+        }
+        wake.notify_all();
+        fn(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return busy == 0; });
+    }
+
+private:
+    void loop(unsigned worker) {
+        TRACE_THREAD_NAME("export worker");
+        uint64_t seen = 0;
+        while (true) {
+            const std::function<void(unsigned)>* pFn;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                pFn = pTask;
+            }
+            (*pFn)(worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) finished.notify_one();
+        }
+    }
+
+    unsigned count;
+    std::vector<std::thread> pool;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const std::function<void(unsigned)>* pTask = nullptr;
+    uint64_t generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+};
+
+// renders [roundStart, roundStart + frames) of every track into its bus, then adds
+// the buses up in track order into mix. the tracks are handed out one at a time,
+// the sum is split into blocks that the workers stripe through
+static void renderMixRound(MixPool& pool, std::vector<MixTrack>& tracks, std::vector<MixWorker>& workers,
+                           ma_uint64 roundStart, ma_uint64 frames, int channels, int sampleRate, float* mix,
+                           const std::function<void(MixWorker&, ma_uint64, ma_uint64)>& afterSum) {
+    TRACE_SCOPE("render round");
+    std::atomic<size_t> nextTrack{0};
+    pool.run([&](unsigned w) {
+        MixWorker& worker = workers[w];
+        for (size_t t = nextTrack++; t < tracks.size(); t = nextTrack++) {
+            MixTrack& track = tracks[t];
+            track.silent = true;
+            for (ma_uint64 done = 0; done < frames; done += kMixBlockFrames) {
+                ma_uint32 chunk = (ma_uint32)std::min<ma_uint64>(kMixBlockFrames, frames - done);
+                if (renderMixBlock(track.sources, track.index, roundStart + done, chunk, channels, sampleRate,
+                                   track.bus.data() + (size_t)done * channels, worker.scratch.data(),
+                                   worker.timed ? &worker.times : nullptr)) {
+                    track.silent = false;
+                }
+            }
+        }
+    });
+
+    const unsigned threads = (unsigned)workers.size();
+    pool.run([&](unsigned w) {
+        MixWorker& worker = workers[w];
+        for (ma_uint64 from = (ma_uint64)w * kMixBlockFrames; from < frames; from += (ma_uint64)threads * kMixBlockFrames) {
+            ma_uint64 count = std::min<ma_uint64>(kMixBlockFrames, frames - from);
+            float* out = mix + (size_t)from * channels;
+            double started = worker.timed ? mixClock() : 0.0;
+            std::fill(out, out + (size_t)count * channels, 0.0f);
+            for (const auto& track : tracks) {
+                if (!track.silent) mix_accumulate(out, track.bus.data() + (size_t)from * channels, (size_t)count * channels);
+            }
+            if (worker.timed) worker.times.mix += mixClock() - started;
+            afterSum(worker, from, count);
+        }
+    });
+}
+
+static void resetMixTracks(std::vector<MixTrack>& tracks) {
+    for (auto& track : tracks) {
+        for (auto& src : track.sources) {
+            closeMixSource(src);
+            src.done = false;
+        }
+    }
+}
+
+const char* mixdownFormatName(MixdownFormat format) {
+    switch (format) {
+        case MixdownFormat::S24: return "24-bit";
+        case MixdownFormat::F32: return "32-bit float";
+        default: return "16-bit";
+    }
+}
+
+static ma_format mixdownSampleFormat(MixdownFormat format) {
+    switch (format) {
+        case MixdownFormat::S24: return ma_format_s24;
+        case MixdownFormat::F32: return ma_format_f32;
+        default: return ma_format_s16;
+    }
+}
+
+// a cancelled or failed export doesn't leave half a file behind. only ever a
+// plain file, the path could be a device or a pipe
+static void removePartialExport(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) remove(path.c_str());
+}
+
+// scales src into dst in the file's format
+static void convertMix(uint8_t* dst, const float* src, size_t samples, MixdownFormat format, float scale) {
+    switch (format) {
+        case MixdownFormat::S24:
+            mix_convert_f32_to_s24(dst, src, samples, scale);
+            break;
+        case MixdownFormat::F32: {
+            // float can't clip, it only gets the same normalization as the others
+            float* out = reinterpret_cast<float*>(dst);
+            for (size_t i = 0; i < samples; i++) out[i] = src[i] * scale;
+            break;
+        }
+        default:
+            mix_convert_f32_to_s16(reinterpret_cast<int16_t*>(dst), src, samples, scale);
+            break;
+    }
+}
+
+bool mixdownAllTracks(const std::vector<std::vector<Segment>>& trackSegments, int64_t sessionFrames, const std::string& exportPath,
+                      unsigned threads, MixdownStats* pStats) {
+    MixdownOptions options;
+    options.threads = threads;
+    return mixdownTracks(trackSegments, sessionFrames, exportPath, options, pStats);
+}
+
+bool mixdownTracks(const std::vector<std::vector<Segment>>& trackSegments, int64_t sessionFrames, const std::string& exportPath,
+                   const MixdownOptions& options, MixdownStats* pStats) {
+    double started = mixClock();
+
+    // later I will make this modifiable, can't be very hard.
+    // (segments are in engine frames, so it has to match that)
+    const int sampleRate = ENGINE_SAMPLE_RATE;
+    const int channels = 2;
+    const int64_t rangeEnd = options.endFrame < 0 ? sessionFrames : std::min(options.endFrame, sessionFrames);
+    const int64_t rangeStart = std::min(std::max<int64_t>(options.startFrame, 0), std::max<int64_t>(rangeEnd, 0));
+    const ma_uint64 totalFrames = (ma_uint64)std::max<int64_t>(rangeEnd - rangeStart, 0);
+    const ma_format sampleFormat = mixdownSampleFormat(options.format);
+
+    MixdownProgress* pProgress = options.pProgress;
+    if (pProgress) {
+        pProgress->framesDone = 0;
+        pProgress->totalFrames = totalFrames * 2;
+    }
+    auto cancelled = [pProgress]() { return pProgress && pProgress->cancel.load(std::memory_order_relaxed); };
+    auto advance = [pProgress](ma_uint64 frames) {
+        if (pProgress) pProgress->framesDone.fetch_add(frames, std::memory_order_relaxed);
+    };
+
+    const ma_uint64 numRounds = (totalFrames + kMixRoundFrames - 1) / kMixRoundFrames;
+
+    // only tracks with something in the range are worth a thread
+    std::vector<MixTrack> tracks(trackSegments.size());
+    for (size_t t = 0; t < trackSegments.size(); ++t) {
+        buildMixTrack(trackSegments[t], (ma_uint64)rangeStart, totalFrames, tracks[t]);
+    }
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(), [](const MixTrack& track) { return track.sources.empty(); }),
+                 tracks.end());
+    for (auto& track : tracks) track.bus.resize((size_t)kMixRoundFrames * channels);
+
+    unsigned threads = options.threads;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::max<size_t>(1, std::min<size_t>(threads, tracks.size()));
+
+    std::vector<MixWorker> workers(threads);
+    for (auto& worker : workers) {
+        worker.scratch.resize((size_t)kMixBlockFrames * channels);
+        worker.peak = 0.0f;
+        worker.timed = pStats != nullptr;
+    }
+    std::vector<float> mix((size_t)kMixRoundFrames * channels);
+    std::vector<uint8_t> out((size_t)kMixRoundFrames * channels * ma_get_bytes_per_sample(sampleFormat));
+    const size_t bytesPerFrame = (size_t)channels * ma_get_bytes_per_sample(sampleFormat);
+    MixPool pool(threads);
+
+    // first pass only finds the peak so we can normalize without keeping the whole mix around
+    TRACE_BEGIN("peak pass");
+    for (ma_uint64 round = 0; round < numRounds && !cancelled(); ++round) {
+        ma_uint64 roundStart = round * kMixRoundFrames;
+        ma_uint64 frames = std::min(kMixRoundFrames, totalFrames - roundStart);
+        renderMixRound(pool, tracks, workers, roundStart, frames, channels, sampleRate, mix.data(),
+                       [&](MixWorker& worker, ma_uint64 from, ma_uint64 count) {
+                           double started = worker.timed ? mixClock() : 0.0;
+                           worker.peak = mix_peak(mix.data() + (size_t)from * channels, (size_t)count * channels, worker.peak);
+                           if (worker.timed) worker.times.normalize += mixClock() - started;
+                       });
+        advance(frames);
+    }
+    TRACE_END("peak pass");
+    // the second pass starts every decoder from the top again
+    resetMixTracks(tracks);
+    if (cancelled()) return false;
+
+    float maxAbs = 0.0f;
+    for (const auto& worker : workers) maxAbs = std::max(maxAbs, worker.peak);
+    float scale = (maxAbs > 1.0f) ? (1.0f / maxAbs) : 1.0f;
+
+    ma_encoder_config encCfg = ma_encoder_config_init(ma_encoding_format_wav, sampleFormat, channels, sampleRate);
+    ma_encoder enc;
+    double encodeStarted = mixClock();
+    if (ma_encoder_init_file(exportPath.c_str(), &encCfg, &enc) != MA_SUCCESS) {
+        return false;
+    }
+    double encodeTime = mixClock() - encodeStarted;
+
+    // second pass converts every round as it's summed and writes it before the next one starts
+    bool stopped = false; // cancelled, or the file couldn't be written
+    for (ma_uint64 round = 0; round < numRounds; ++round) {
+        if (cancelled()) {
+            stopped = true;
+            break;
+        }
+        ma_uint64 roundStart = round * kMixRoundFrames;
+        ma_uint64 frames = std::min(kMixRoundFrames, totalFrames - roundStart);
+        renderMixRound(pool, tracks, workers, roundStart, frames, channels, sampleRate, mix.data(),
+                       [&](MixWorker& worker, ma_uint64 from, ma_uint64 count) {
+                           double started = worker.timed ? mixClock() : 0.0;
+                           convertMix(out.data() + (size_t)from * bytesPerFrame, mix.data() + (size_t)from * channels,
+                                      (size_t)count * channels, options.format, scale);
+                           if (worker.timed) worker.times.normalize += mixClock() - started;
+                       });
+        encodeStarted = mixClock();
+        TRACE_BEGIN("encode");
+        // the wav encoder always says MA_SUCCESS, a full disk only shows in the count
+        ma_uint64 written = 0;
+        bool wrote = ma_encoder_write_pcm_frames(&enc, out.data(), frames, &written) == MA_SUCCESS && written == frames;
+        TRACE_END("encode");
+        encodeTime += mixClock() - encodeStarted;
+        if (!wrote) {
+            stopped = true;
+            break;
+        }
+        advance(frames);
+    }
+    resetMixTracks(tracks);
+    encodeStarted = mixClock();
+    ma_encoder_uninit(&enc);
+    encodeTime += mixClock() - encodeStarted;
+    // uninit flushes the last of it without saying whether that worked, so the
+    // file has to be at least as big as its header and the audio
+    struct stat st;
+    if (!stopped && (stat(exportPath.c_str(), &st) != 0 || (uint64_t)st.st_size < totalFrames * bytesPerFrame + 44)) {
+        stopped = true;
+    }
+    if (stopped) {
+        removePartialExport(exportPath);
+        return false;
+    }
+
+    if (pStats) {
+        *pStats = MixdownStats();
+        for (const auto& worker : workers) {
+            pStats->decodeSeconds += worker.times.decode;
+            pStats->mixSeconds += worker.times.mix;
+            pStats->normalizeSeconds += worker.times.normalize;
+            pStats->decodedFrames += worker.times.decodedFrames;
+        }
+        pStats->encodeSeconds = encodeTime;
+        pStats->totalSeconds = mixClock() - started;
+        pStats->frames = totalFrames;
+        pStats->threads = threads;
+    }
+    return true;
+}
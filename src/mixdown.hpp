@@ -0,0 +1,55 @@
+#pragma once
+
+#include "sessionfile.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// where a mixdown spent its time. the stages are summed over all the export
+// threads, so with more than one they add up to more than totalSeconds
+struct MixdownStats {
+    double decodeSeconds = 0.0;    // opening, seeking and decoding the takes (both passes)
+    double mixSeconds = 0.0;       // summing them into the mix bus
+    double normalizeSeconds = 0.0; // finding the peak and converting to the file's format
+    double encodeSeconds = 0.0;    // writing the file, only ever on the calling thread
+    double totalSeconds = 0.0;     // wall clock for the whole call
+    uint64_t frames = 0;           // frames in the exported file
+    uint64_t decodedFrames = 0;    // frames read from the takes, at the engine rate
+    unsigned threads = 0;
+};
+
+// sample format of the exported wav
+enum class MixdownFormat { S16, S24, F32 };
+
+const char* mixdownFormatName(MixdownFormat format);
+
+// lets another thread watch a mixdown and stop it. both passes count, so
+// framesDone ends up at totalFrames = 2 * the frames being exported. cancel is
+// looked at between rounds of the mix, the partly written file gets removed
+struct MixdownProgress {
+    std::atomic<uint64_t> framesDone{0};
+    std::atomic<uint64_t> totalFrames{0};
+    std::atomic<bool> cancel{false};
+};
+
+struct MixdownOptions {
+    int64_t startFrame = 0;  // the part of the session to export
+    int64_t endFrame = -1;   // < 0 is the end of the session
+    MixdownFormat format = MixdownFormat::S16;
+    unsigned threads = 0;    // 0 is one per core
+    MixdownProgress* pProgress = nullptr;
+};
+
+// renders every track into a wav at the engine rate, normalized if it would
+// clip. runs offline (no audio device) on up to options.threads threads, and the
+// file comes out the same whatever the thread count. returns false if the file
+// couldn't be written or the mixdown got cancelled.
+// pStats (can be null) gets the timings, timing costs a little so leave it off otherwise
+bool mixdownTracks(const std::vector<std::vector<Segment>>& trackSegments, int64_t sessionFrames, const std::string& exportPath,
+                   const MixdownOptions& options, MixdownStats* pStats = nullptr);
+
+// the whole session as a 16-bit wav (render and the benchmark use this)
+bool mixdownAllTracks(const std::vector<std::vector<Segment>>& trackSegments, int64_t sessionFrames, const std::string& exportPath,
+                      unsigned threads = 0, MixdownStats* pStats = nullptr);
@@ -0,0 +1,362 @@
+#include "mixkernels.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MIX_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// plain C versions, also used for the tails the vector loops leave over
+
+static void accumulate_scalar(float* dst, const float* src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) dst[i] += src[i];
+}
+
+static void accumulate_gain_scalar(float* dst, const float* src, size_t n, float gain)
+{
+    for (size_t i = 0; i < n; ++i) dst[i] += src[i] * gain;
+}
+
+static float peak_scalar(const float* src, size_t n, float peak)
+{
+    for (size_t i = 0; i < n; ++i) {
+        float v = src[i] < 0.0f ? -src[i] : src[i];
+        if (v > peak) peak = v;
+    }
+    return peak;
+}
+
+static inline float clamp_unit(float v)
+{
+    if (v > 1.0f) v = 1.0f;
+    if (v < -1.0f) v = -1.0f;
+    return v;
+}
+
+static void convert_s16_scalar(int16_t* dst, const float* src, size_t n, float gain)
+{
+    for (size_t i = 0; i < n; ++i) dst[i] = (int16_t)(clamp_unit(src[i] * gain) * 32767.0f);
+}
+
+static inline void store_s24(uint8_t* dst, int32_t v)
+{
+    dst[0] = (uint8_t)(v & 0xFF);
+    dst[1] = (uint8_t)((v >> 8) & 0xFF);
+    dst[2] = (uint8_t)((v >> 16) & 0xFF);
+}
+
+static void convert_s24_scalar(uint8_t* dst, const float* src, size_t n, float gain)
+{
+    for (size_t i = 0; i < n; ++i) store_s24(dst + i * 3, (int32_t)(clamp_unit(src[i] * gain) * 8388607.0f));
+}
+
+#ifdef MIX_KERNELS_X86
+
+// sse2 (every x86-64 cpu has it)
+
+__attribute__((target("sse2")))
+static void accumulate_sse2(float* dst, const float* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+    }
+    accumulate_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void accumulate_gain_sse2(float* dst, const float* src, size_t n, float gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), v));
+    }
+    accumulate_gain_scalar(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("sse2")))
+static float peak_sse2(const float* src, size_t n, float peak)
+{
+    __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 m = _mm_set1_ps(peak);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(src + i), absMask));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    for (int l = 0; l < 4; ++l) if (lanes[l] > peak) peak = lanes[l];
+    return peak_scalar(src + i, n - i, peak);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i to_int_sse2(const float* src, __m128 g, __m128 scale)
+{
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(src), g);
+    v = _mm_max_ps(_mm_min_ps(v, _mm_set1_ps(1.0f)), _mm_set1_ps(-1.0f));
+    return _mm_cvttps_epi32(_mm_mul_ps(v, scale));
+}
+
+__attribute__((target("sse2")))
+static void convert_s16_sse2(int16_t* dst, const float* src, size_t n, float gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+    __m128 scale = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = to_int_sse2(src + i, g, scale);
+        __m128i hi = to_int_sse2(src + i + 4, g, scale);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+    convert_s16_scalar(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("sse2")))
+static void convert_s24_sse2(uint8_t* dst, const float* src, size_t n, float gain)
+{
+    __m128 g = _mm_set1_ps(gain);
+    __m128 scale = _mm_set1_ps(8388607.0f);
+    int32_t tmp[4];
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_si128((__m128i*)tmp, to_int_sse2(src + i, g, scale));
+        for (int l = 0; l < 4; ++l) store_s24(dst + (i + l) * 3, tmp[l]);
+    }
+    convert_s24_scalar(dst + i * 3, src + i, n - i, gain);
+}
+
+// avx2
+
+__attribute__((target("avx2")))
+static void accumulate_avx2(float* dst, const float* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+    }
+    accumulate_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void accumulate_gain_avx2(float* dst, const float* src, size_t n, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), v));
+    }
+    accumulate_gain_scalar(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("avx2")))
+static float peak_avx2(const float* src, size_t n, float peak)
+{
+    __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 m = _mm256_set1_ps(peak);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        m = _mm256_max_ps(m, _mm256_and_ps(_mm256_loadu_ps(src + i), absMask));
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, m);
+    for (int l = 0; l < 8; ++l) if (lanes[l] > peak) peak = lanes[l];
+    return peak_scalar(src + i, n - i, peak);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i to_int_avx2(const float* src, __m256 g, __m256 scale)
+{
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src), g);
+    v = _mm256_max_ps(_mm256_min_ps(v, _mm256_set1_ps(1.0f)), _mm256_set1_ps(-1.0f));
+    return _mm256_cvttps_epi32(_mm256_mul_ps(v, scale));
+}
+
+__attribute__((target("avx2")))
+static void convert_s16_avx2(int16_t* dst, const float* src, size_t n, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    __m256 scale = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i lo = to_int_avx2(src + i, g, scale);
+        __m256i hi = to_int_avx2(src + i + 8, g, scale);
+        // packs works per 128 bit lane, put the quadwords back in order afterwards
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i*)(dst + i), packed);
+    }
+    convert_s16_scalar(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("avx2")))
+static void convert_s24_avx2(uint8_t* dst, const float* src, size_t n, float gain)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    __m256 scale = _mm256_set1_ps(8388607.0f);
+    int32_t tmp[8];
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_si256((__m256i*)tmp, to_int_avx2(src + i, g, scale));
+        for (int l = 0; l < 8; ++l) store_s24(dst + (i + l) * 3, tmp[l]);
+    }
+    convert_s24_scalar(dst + i * 3, src + i, n - i, gain);
+}
+
+// avx-512 (only needs the foundation subset)
+
+__attribute__((target("avx512f")))
+static void accumulate_avx512(float* dst, const float* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(dst + i), _mm512_loadu_ps(src + i)));
+    }
+    accumulate_scalar(dst + i, src + i, n - i);
+}
+
+// avx-512 brings fma along, keep gcc from fusing the multiply and add so the
+// result matches the other kernels bit for bit
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+#else
+__attribute__((target("avx512f")))
+#endif
+static void accumulate_gain_avx512(float* dst, const float* src, size_t n, float gain)
+{
+    __m512 g = _mm512_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = _mm512_mul_ps(_mm512_loadu_ps(src + i), g);
+        _mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(dst + i), v));
+    }
+    accumulate_gain_scalar(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("avx512f")))
+static float peak_avx512(const float* src, size_t n, float peak)
+{
+    __m512 m = _mm512_set1_ps(peak);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        m = _mm512_max_ps(m, _mm512_abs_ps(_mm512_loadu_ps(src + i)));
+    }
+    float lanes[16];
+    _mm512_storeu_ps(lanes, m);
+    for (int l = 0; l < 16; ++l) if (lanes[l] > peak) peak = lanes[l];
+    return peak_scalar(src + i, n - i, peak);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i to_int_avx512(const float* src, __m512 g, __m512 scale)
+{
+    __m512 v = _mm512_mul_ps(_mm512_loadu_ps(src), g);
+    v = _mm512_max_ps(_mm512_min_ps(v, _mm512_set1_ps(1.0f)), _mm512_set1_ps(-1.0f));
+    return _mm512_cvttps_epi32(_mm512_mul_ps(v, scale));
+}
+
+__attribute__((target("avx512f")))
+static void convert_s16_avx512(int16_t* dst, const float* src, size_t n, float gain)
+{
+    __m512 g = _mm512_set1_ps(gain);
+    __m512 scale = _mm512_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        // saturating narrow, keeps the order unlike packs
+        __m256i packed = _mm512_cvtsepi32_epi16(to_int_avx512(src + i, g, scale));
+        _mm256_storeu_si256((__m256i*)(dst + i), packed);
+    }
+    convert_s16_scalar(dst + i, src + i, n - i, gain);
+}
+
+__attribute__((target("avx512f")))
+static void convert_s24_avx512(uint8_t* dst, const float* src, size_t n, float gain)
+{
+    __m512 g = _mm512_set1_ps(gain);
+    __m512 scale = _mm512_set1_ps(8388607.0f);
+    int32_t tmp[16];
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_si512((void*)tmp, to_int_avx512(src + i, g, scale));
+        for (int l = 0; l < 16; ++l) store_s24(dst + (i + l) * 3, tmp[l]);
+    }
+    convert_s24_scalar(dst + i * 3, src + i, n - i, gain);
+}
+
+#endif // MIX_KERNELS_X86
+
+// runtime dispatch
+
+typedef struct {
+    const char* name;
+    void (*accumulate)(float*, const float*, size_t);
+    void (*accumulateGain)(float*, const float*, size_t, float);
+    float (*peak)(const float*, size_t, float);
+    void (*convertS16)(int16_t*, const float*, size_t, float);
+    void (*convertS24)(uint8_t*, const float*, size_t, float);
+} MixKernels;
+
+static MixKernels g_kernels;
+static pthread_once_t g_kernelsOnce = PTHREAD_ONCE_INIT;
+
+static void pick_kernels(void)
+{
+    MixKernels k = { "scalar", accumulate_scalar, accumulate_gain_scalar, peak_scalar,
+                     convert_s16_scalar, convert_s24_scalar };
+#ifdef MIX_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        MixKernels avx512 = { "avx512", accumulate_avx512, accumulate_gain_avx512, peak_avx512,
+                              convert_s16_avx512, convert_s24_avx512 };
+        k = avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        MixKernels avx2 = { "avx2", accumulate_avx2, accumulate_gain_avx2, peak_avx2,
+                            convert_s16_avx2, convert_s24_avx2 };
+        k = avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        MixKernels sse2 = { "sse2", accumulate_sse2, accumulate_gain_sse2, peak_sse2,
+                            convert_s16_sse2, convert_s24_sse2 };
+        k = sse2;
+    }
+#endif
+    g_kernels = k;
+}
+
+static inline const MixKernels* kernels(void)
+{
+    pthread_once(&g_kernelsOnce, pick_kernels);
+    return &g_kernels;
+}
+
+void mix_accumulate(float* dst, const float* src, size_t n)
+{
+    kernels()->accumulate(dst, src, n);
+}
+
+void mix_accumulate_gain(float* dst, const float* src, size_t n, float gain)
+{
+    kernels()->accumulateGain(dst, src, n, gain);
+}
+
+float mix_peak(const float* src, size_t n, float peak)
+{
+    return kernels()->peak(src, n, peak);
+}
+
+void mix_convert_f32_to_s16(int16_t* dst, const float* src, size_t n, float gain)
+{
+    kernels()->convertS16(dst, src, n, gain);
+}
+
+void mix_convert_f32_to_s24(uint8_t* dst, const float* src, size_t n, float gain)
+{
+    kernels()->convertS24(dst, src, n, gain);
+}
+
+const char* mix_kernels_name()
+{
+    return kernels()->name;
+}
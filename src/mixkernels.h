@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+// to ensure C compatability
+extern "C" {
+#endif
+
+// hot loops of the mixdown. every function picks the widest instruction set the
+// cpu has (avx-512, avx2, sse2) the first time it's called and falls back to plain C.
+// all buffers are interleaved samples, n is the number of samples (not frames).
+
+// dst[i] += src[i]
+void mix_accumulate(float* dst, const float* src, size_t n);
+
+// dst[i] += src[i] * gain
+void mix_accumulate_gain(float* dst, const float* src, size_t n, float gain);
+
+// largest |src[i]|, starting from peak
+float mix_peak(const float* src, size_t n, float peak);
+
+// clamp(src[i] * gain, -1, 1) scaled to int16
+void mix_convert_f32_to_s16(int16_t* dst, const float* src, size_t n, float gain);
+
+// same as above but packed little endian 24 bit (3 bytes per sample)
+void mix_convert_f32_to_s24(uint8_t* dst, const float* src, size_t n, float gain);
+
+// name of the kernels that got picked ("avx512", "avx2", "sse2" or "scalar")
+const char* mix_kernels_name();
+
+#ifdef __cplusplus
+}
+#endif
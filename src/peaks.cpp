@@ -0,0 +1,269 @@
+#include "peaks.hpp"
+#include "audiomanager.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// on disk: this header, then every level's pairs one after the other
+struct PeakHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t sampleRate;
+    uint32_t baseBlock;
+    uint32_t factor;
+    uint32_t levels;
+    uint64_t frames;
+    // the audio file these were built from, a changed file means stale peaks
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t levelOffset[kMaxPeakLevels];
+    uint64_t levelCount[kMaxPeakLevels];
+};
+
+struct PeakPair {
+    int16_t lo;
+    int16_t hi;
+};
+
+static const char kPeakMagic[4] = {'C', 'W', 'P', 'K'};
+static const uint32_t kPeakVersion = 1;
+
+static int16_t toPeak(float sample) {
+    return (int16_t)std::lrint(std::max(-1.0f, std::min(1.0f, sample)) * 32767.0f);
+}
+
+PeakFile::~PeakFile() {
+    if (map) munmap(map, mapSize);
+}
+
+bool PeakFile::open(const std::string& peakPath, const std::string& audioPath) {
+    struct stat audioStat;
+    if (stat(audioPath.c_str(), &audioStat) != 0) return false;
+
+    int fd = ::open(peakPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat peakStat;
+    if (fstat(fd, &peakStat) != 0 || (size_t)peakStat.st_size < sizeof(PeakHeader)) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, peakStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    const PeakHeader* header = (const PeakHeader*)data;
+    bool valid = memcmp(header->magic, kPeakMagic, 4) == 0 && header->version == kPeakVersion &&
+                 header->sampleRate == ENGINE_SAMPLE_RATE && header->baseBlock == kPeakBaseBlock &&
+                 header->factor == kPeakFactor && header->levels > 0 && header->levels <= (uint32_t)kMaxPeakLevels &&
+                 header->sourceSize == (uint64_t)audioStat.st_size && header->sourceMtime == (int64_t)audioStat.st_mtime;
+    for (uint32_t l = 0; valid && l < header->levels; l++) {
+        valid = header->levelCount[l] > 0 &&
+                header->levelOffset[l] + header->levelCount[l] * sizeof(PeakPair) <= (uint64_t)peakStat.st_size;
+    }
+    if (!valid) {
+        munmap(data, peakStat.st_size);
+        return false;
+    }
+    if (map) munmap(map, mapSize);
+    map = data;
+    mapSize = peakStat.st_size;
+    return true;
+}
+
+uint64_t PeakFile::frames() const {
+    return map ? ((const PeakHeader*)map)->frames : 0;
+}
+
+bool PeakFile::range(uint64_t first, uint64_t end, float& lo, float& hi) const {
+    if (!map) return false;
+    const PeakHeader* header = (const PeakHeader*)map;
+    end = std::min(end, header->frames);
+    if (first >= end) return false;
+
+    // the coarsest level whose blocks still fit in the range, so a cell never
+    // needs more than about kPeakFactor + 1 pairs however far out we're zoomed
+    uint64_t span = end - first;
+    uint32_t level = 0;
+    uint64_t block = kPeakBaseBlock;
+    while (level + 1 < header->levels && block * kPeakFactor <= span) {
+        block *= kPeakFactor;
+        level++;
+    }
+
+    const PeakPair* pairs = (const PeakPair*)((const char*)map + header->levelOffset[level]);
+    uint64_t count = header->levelCount[level];
+    uint64_t firstPair = std::min(first / block, count - 1);
+    uint64_t lastPair = std::min((end - 1) / block, count - 1);
+    int16_t low = pairs[firstPair].lo, high = pairs[firstPair].hi;
+    for (uint64_t i = firstPair + 1; i <= lastPair; i++) {
+        low = std::min(low, pairs[i].lo);
+        high = std::max(high, pairs[i].hi);
+    }
+    lo = low / 32767.0f;
+    hi = high / 32767.0f;
+    return true;
+}
+
+// decodes the whole take once (at the engine rate, all channels folded together)
+// and writes every level. goes through a temp file so a half-written one is never picked up
+static bool buildPeakFile(const std::string& audioPath, const std::string& peakPath, const std::atomic<bool>& stopping) {
+    struct stat audioStat;
+    if (stat(audioPath.c_str(), &audioStat) != 0) return false;
+
+    ma_decoder decoder;
+    ma_decoder_config decCfg = ma_decoder_config_init(ma_format_f32, 0, ENGINE_SAMPLE_RATE);
+    if (ma_decoder_init_file(audioPath.c_str(), &decCfg, &decoder) != MA_SUCCESS) return false;
+    ma_uint32 channels = decoder.outputChannels;
+
+    std::vector<std::vector<PeakPair>> levels(1);
+    std::vector<float> chunk((size_t)kPeakBaseBlock * 1024 * channels);
+    uint64_t frames = 0;
+    float blockLo = 0.0f, blockHi = 0.0f;
+    uint32_t inBlock = 0;
+    while (!stopping) {
+        ma_uint64 got = 0;
+        ma_result res = ma_decoder_read_pcm_frames(&decoder, chunk.data(), kPeakBaseBlock * 1024, &got);
+        for (ma_uint64 f = 0; f < got; f++) {
+            for (ma_uint32 c = 0; c < channels; c++) {
+                float sample = chunk[f * channels + c];
+                if (inBlock == 0 && c == 0) blockLo = blockHi = sample;
+                blockLo = std::min(blockLo, sample);
+                blockHi = std::max(blockHi, sample);
+            }
+            if (++inBlock == kPeakBaseBlock) {
+                levels[0].push_back({toPeak(blockLo), toPeak(blockHi)});
+                inBlock = 0;
+            }
+        }
+        frames += got;
+        if (res != MA_SUCCESS || got == 0) break;
+    }
+    ma_decoder_uninit(&decoder);
+    if (stopping) return false;
+    if (inBlock > 0) levels[0].push_back({toPeak(blockLo), toPeak(blockHi)});
+    if (levels[0].empty()) levels[0].push_back({0, 0});
+
+    while (levels.back().size() > 1 && (int)levels.size() < kMaxPeakLevels) {
+        const std::vector<PeakPair>& below = levels.back();
+        std::vector<PeakPair> level((below.size() + kPeakFactor - 1) / kPeakFactor);
+        for (size_t i = 0; i < level.size(); i++) {
+            PeakPair pair = below[i * kPeakFactor];
+            for (size_t j = i * kPeakFactor + 1; j < std::min(below.size(), (i + 1) * kPeakFactor); j++) {
+                pair.lo = std::min(pair.lo, below[j].lo);
+                pair.hi = std::max(pair.hi, below[j].hi);
+            }
+            level[i] = pair;
+        }
+        levels.push_back(std::move(level));
+    }
+
+    PeakHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kPeakMagic, 4);
+    header.version = kPeakVersion;
+    header.sampleRate = ENGINE_SAMPLE_RATE;
+    header.baseBlock = kPeakBaseBlock;
+    header.factor = kPeakFactor;
+    header.levels = (uint32_t)levels.size();
+    header.frames = frames;
+    header.sourceSize = (uint64_t)audioStat.st_size;
+    header.sourceMtime = (int64_t)audioStat.st_mtime;
+    uint64_t offset = sizeof(header);
+    for (size_t l = 0; l < levels.size(); l++) {
+        header.levelOffset[l] = offset;
+        header.levelCount[l] = levels[l].size();
+        offset += levels[l].size() * sizeof(PeakPair);
+    }
+
+    std::string tmpPath = peakPath + ".tmp";
+    FILE* out = fopen(tmpPath.c_str(), "wb");
+    if (!out) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    for (size_t l = 0; ok && l < levels.size(); l++) {
+        ok = fwrite(levels[l].data(), sizeof(PeakPair), levels[l].size(), out) == levels[l].size();
+    }
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), peakPath.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+PeakCache::PeakCache() {
+    notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    builder = std::thread(&PeakCache::builderThread, this);
+}
+
+PeakCache::~PeakCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    builder.join();
+    if (notifyFd >= 0) close(notifyFd);
+}
+
+std::string PeakCache::peakPathFor(const std::string& audioPath) {
+    return audioPath + ".peaks";
+}
+
+const PeakFile* PeakCache::get(const std::string& audioPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(audioPath);
+    if (it == entries.end()) {
+        entries[audioPath];
+        queue.push_back(audioPath);
+        wake.notify_one();
+        return nullptr;
+    }
+    return it->second.state == State::Ready ? it->second.peaks.get() : nullptr;
+}
+
+void PeakCache::clearEvents() {
+    uint64_t count;
+    ssize_t got = read(notifyFd, &count, sizeof(count));
+    (void)got;
+}
+
+void PeakCache::builderThread() {
+    TRACE_THREAD_NAME("peak builder");
+    while (true) {
+        std::string audioPath;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || !queue.empty(); });
+            if (stopping) return;
+            audioPath = queue.front();
+            queue.pop_front();
+        }
+
+        // peaks cached by an earlier session are used as long as the take hasn't changed
+        std::string peakPath = peakPathFor(audioPath);
+        std::unique_ptr<PeakFile> peaks(new PeakFile());
+        TRACE_BEGIN("build peaks");
+        bool ok = peaks->open(peakPath, audioPath) ||
+                  (buildPeakFile(audioPath, peakPath, stopping) && peaks->open(peakPath, audioPath));
+        TRACE_END("build peaks");
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry& entry = entries[audioPath];
+            entry.state = ok ? State::Ready : State::Failed;
+            if (ok) entry.peaks = std::move(peaks);
+        }
+        uint64_t one = 1;
+        ssize_t written = write(notifyFd, &one, sizeof(one));
+        (void)written;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// min/max peaks of a take at a few resolutions, mmapped from the ".peaks" file
+// next to it. level 0 has one min/max pair per kPeakBaseBlock frames, every
+// level above is kPeakFactor times coarser, up to a single pair for the whole
+// take. frames are at the engine rate, whatever rate the file itself is at.
+static const uint32_t kPeakBaseBlock = 64;
+static const uint32_t kPeakFactor = 4;
+static const int kMaxPeakLevels = 16;
+
+class PeakFile {
+public:
+    ~PeakFile();
+
+    // fails if the file is missing, damaged or older than the audio it describes
+    bool open(const std::string& peakPath, const std::string& audioPath);
+    uint64_t frames() const;
+    // lowest and highest sample in [first, end). reads at most a handful of
+    // pairs from whichever level is coarsest without going past the range
+    bool range(uint64_t first, uint64_t end, float& lo, float& hi) const;
+
+private:
+    void* map = nullptr;
+    size_t mapSize = 0;
+};
+
+// builds peak files on a background thread and keeps the finished ones open.
+// the ui asks for peaks every frame and draws whatever is ready so far
+class PeakCache {
+public:
+    PeakCache();
+    ~PeakCache();
+
+    // the peaks if they're ready, otherwise queues a build (just once) and returns null
+    const PeakFile* get(const std::string& audioPath);
+    // readable whenever a build finished since clearEvents()
+    int eventFd() const { return notifyFd; }
+    void clearEvents();
+
+    static std::string peakPathFor(const std::string& audioPath);
+
+private:
+    enum class State { Queued, Ready, Failed };
+    struct Entry {
+        State state = State::Queued;
+        std::unique_ptr<PeakFile> peaks;
+    };
+
+    void builderThread();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::string> queue;
+    std::map<std::string, Entry> entries;
+    std::atomic<bool> stopping{false};
+    int notifyFd = -1;
+    std::thread builder;
+};
@@ -0,0 +1,78 @@
+#include "cliwave.hpp"
+#include "engine.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <unistd.h>
+
+// cliwave render session.cws -o out.wav [--threads N]
+// no terminal, no audio device, just the mixdown. exit codes:
+// 0 rendered, 1 couldn't load the session (or its audio), 2 bad arguments, 3 render failed
+static void printRenderUsage() {
+    fprintf(stderr, "usage: cliwave render <session.cws> -o <out.wav> [--threads N]\n");
+}
+
+int runRenderCommand(int argc, char** argv) {
+    const char* sessionPath = nullptr;
+    const char* outPath = nullptr;
+    unsigned threads = 0;
+    for (int i = 0; i < argc; i++) {
+        if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc) {
+            char* end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 0) {
+                printRenderUsage();
+                return 2;
+            }
+            threads = (unsigned)n;
+        } else if (argv[i][0] != '-' && !sessionPath) {
+            sessionPath = argv[i];
+        } else {
+            printRenderUsage();
+            return 2;
+        }
+    }
+    if (!sessionPath || !outPath) {
+        printRenderUsage();
+        return 2;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    SessionData session;
+    std::string error;
+    if (!loadSession(sessionPath, session, error)) {
+        fprintf(stderr, "Couldn't load %s: %s\n", sessionPath, error.c_str());
+        return 1;
+    }
+
+    // a render node missing a take should fail loudly, not hand back a quieter mix
+    std::set<std::string> missing;
+    for (const auto& track : session.tracks) {
+        for (const auto& seg : track) {
+            if (access(seg.filename.c_str(), R_OK) != 0) missing.insert(seg.filename);
+        }
+    }
+    if (!missing.empty()) {
+        for (const auto& name : missing) fprintf(stderr, "Missing audio: %s\n", name.c_str());
+        return 1;
+    }
+
+    if (!mixdownAllTracks(session.tracks, session.lengthFrames, outPath, threads)) {
+        fprintf(stderr, "Render failed: couldn't write %s\n", outPath);
+        return 3;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    double length = double(session.lengthFrames) / ENGINE_SAMPLE_RATE;
+    printf("Rendered %s -> %s (%.1f s of audio in %.2f s, %.0fx realtime)\n", sessionPath, outPath, length, seconds,
+           seconds > 0 ? length / seconds : 0.0);
+    // only with tracing compiled in
+    std::string tracePath = std::string(outPath) + ".trace.json";
+    if (trace_dump(tracePath.c_str())) printf("Trace written to %s\n", tracePath.c_str());
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include "cliwave.hpp"
-#include "audiomanager.h"
+#include "engine.hpp"
+#include "dawscreen.hpp"
+#include "uievents.hpp"
 
 // other includes (im trying to keep it relatively minimal)
 #include <fstream>
@@ -8,10 +10,11 @@
 #include <sys/types.h>
 #include <vector> // surprised I didn't have a need for this earlier
 #include <cmath> // for fabs
-
-class Segment {public: int startPos; int length; std::string filename;};
-
-static bool mixdownAllTracks(const std::vector<std::vector<Segment>>& trackSegments, int maxTimeSeconds, const std::string& exportPath);
+#include <algorithm>
+#include <map>
+#include <chrono>
+#include <unistd.h>
+#include <thread>
 
 // helpers:
 static bool ensureDir(const std::string& path) {
@@ -130,154 +133,515 @@ void showEditSessionScreen(char* sessionName, char* sessionLength, char* bufferL
     getch();
 }
 
+// zoom steps in frames per cell, from single samples up to minutes. zooming out
+// past the last one that's smaller than the session ends at "whole session"
+static const uint64_t kZoomLevels[] = {
+    1, 2, 5, 10, 20, 50, 100, 200, 441, 882, 2205, 4410, 8820, 22050, 44100,
+    88200, 220500, 441000, 882000, 2646000, 5292000, 13230000,
+};
+
+static uint64_t zoomIn(uint64_t framesPerCell) {
+    uint64_t next = 1;
+    for (uint64_t level : kZoomLevels) {
+        if (level < framesPerCell) next = level;
+    }
+    return next;
+}
+
+static uint64_t zoomOut(uint64_t framesPerCell, uint64_t wholeSession) {
+    if (framesPerCell >= wholeSession) return framesPerCell;
+    for (uint64_t level : kZoomLevels) {
+        if (level > framesPerCell) return std::min(level, wholeSession);
+    }
+    return wholeSession;
+}
+
+static std::string formatZoom(uint64_t framesPerCell) {
+    char text[32];
+    if (framesPerCell * 1000 < ENGINE_SAMPLE_RATE) {
+        snprintf(text, sizeof(text), "%llu smp", (unsigned long long)framesPerCell);
+    } else if (framesPerCell < ENGINE_SAMPLE_RATE) {
+        snprintf(text, sizeof(text), "%.1f ms", framesPerCell * 1000.0 / ENGINE_SAMPLE_RATE);
+    } else {
+        snprintf(text, sizeof(text), "%.1f s", double(framesPerCell) / ENGINE_SAMPLE_RATE);
+    }
+    return text;
+}
+
+// how much of the time the callback had it actually used, in percent
+static double dspLoadPercent(uint64_t ns, uint64_t frames) {
+    return frames > 0 ? 100.0 * ns * ENGINE_SAMPLE_RATE / (frames * 1e9) : 0.0;
+}
+
+// the rows of the engine stats panel (T). the load "now" is since the last time
+// the panel was drawn, everything else is since the device opened
+static void engineStatsLines(const CallbackTiming& timing, const CallbackTiming& previous, std::vector<StatusLine>& status) {
+    char line[512];
+    double loadNow = dspLoadPercent(timing.totalNs - previous.totalNs, timing.totalFrames - previous.totalFrames);
+    double deadlineUs = timing.callbacks ? 1e6 * timing.totalFrames / timing.callbacks / ENGINE_SAMPLE_RATE : 0.0;
+    snprintf(line, sizeof(line), "DSP load: %3.0f%% (avg %.0f%%, p99 %.0f%%) | Callback: %.0f us avg, %.0f us max, %.0f us deadline",
+             loadNow, dspLoadPercent(timing.totalNs, timing.totalFrames), callback_load_percentile(&timing, 0.99),
+             timing.callbacks ? timing.totalNs / 1e3 / timing.callbacks : 0.0, timing.maxNs / 1e3, deadlineUs);
+    status.push_back({line, loadNow >= 75.0 ? A_BOLD : A_NORMAL});
+
+    snprintf(line, sizeof(line), "Xruns: %llu late callbacks | %llu underrun periods | %llu overrun periods",
+             (unsigned long long)timing.lateCallbacks, (unsigned long long)timing.underruns,
+             (unsigned long long)timing.overruns);
+    bool xruns = timing.lateCallbacks || timing.underruns || timing.overruns;
+    status.push_back({line, xruns ? A_BOLD : A_NORMAL});
+
+    // the histogram in quarters of the period, the last one is everything that ran out of time
+    uint64_t quarters[5] = {0, 0, 0, 0, 0};
+    for (int i = 0; i < CALLBACK_LOAD_BUCKETS; i++) quarters[std::min(i / 25, 4)] += timing.loadHistogram[i];
+    snprintf(line, sizeof(line), "Load: <25%% %llu | 25-50%% %llu | 50-75%% %llu | 75-100%% %llu | 100%%+ %llu",
+             (unsigned long long)quarters[0], (unsigned long long)quarters[1], (unsigned long long)quarters[2],
+             (unsigned long long)quarters[3], (unsigned long long)quarters[4]);
+    status.push_back({line, A_NORMAL});
+}
+
+// m:ss, for the export eta
+static std::string formatDuration(double seconds) {
+    char text[32];
+    long whole = (long)(seconds + 0.5);
+    snprintf(text, sizeof(text), "%ld:%02ld", whole / 60, whole % 60);
+    return text;
+}
+
+// one row per export that's queued or running, with a progress bar
+static void exportLines(const std::vector<ExportQueue::Job>& jobs, std::vector<StatusLine>& status) {
+    const int barWidth = 20;
+    for (const auto& job : jobs) {
+        char line[512];
+        std::string name = baseName(job.path);
+        if (job.state == ExportQueue::State::Queued) {
+            snprintf(line, sizeof(line), "Export %d: queued | %s (%s)", job.id, name.c_str(), mixdownFormatName(job.format));
+        } else if (job.state == ExportQueue::State::Running) {
+            int filled = std::min(barWidth, (int)(job.progress * barWidth));
+            std::string bar = std::string(filled, '#') + std::string(barWidth - filled, '.');
+            snprintf(line, sizeof(line), "Export %d: [%s] %3.0f%% | %.1fx realtime | ETA %s | %s (%s, %u threads)",
+                     job.id, bar.c_str(), job.progress * 100.0, job.realtime,
+                     job.etaSeconds >= 0 ? formatDuration(job.etaSeconds).c_str() : "-:--", name.c_str(),
+                     mixdownFormatName(job.format), job.threads);
+        } else {
+            continue;
+        }
+        status.push_back({line, A_NORMAL});
+    }
+}
+
+// waveform heights for a single text row, quietest to loudest
+static const char kPeakGlyphs[] = "_.-:=+*#";
+
+// fills the visible cells a span of session frames touches. a span shorter
+// than a cell still gets one, so zoomed out a take never disappears
+static void markLaneCells(std::string& lane, uint64_t firstCell, uint64_t framesPerCell,
+                          uint64_t startFrame, uint64_t endFrame, char glyph) {
+    if (endFrame <= startFrame) return;
+    uint64_t first = std::max(firstCell, startFrame / framesPerCell);
+    uint64_t last = std::min<uint64_t>(firstCell + lane.size(), (endFrame + framesPerCell - 1) / framesPerCell);
+    for (uint64_t cell = first; cell < last; cell++) lane[cell - firstCell] = glyph;
+}
+
+// the visible cells of one lane, straight from the track's segments. takes
+// whose peaks are ready show their waveform (one peak query per cell, so the
+// same cost at any zoom), the rest are 'x' until then
+static std::string laneCells(const std::vector<Segment>& segments, const IntervalIndex& index, PeakCache& peaks,
+                             uint64_t firstCell, int cells, uint64_t framesPerCell) {
+    std::string lane(cells, ' ');
+    uint64_t endCell = firstCell + cells;
+    index.overlapping(firstCell * framesPerCell, endCell * framesPerCell, [&](const IntervalIndex::Span& span) {
+        const Segment& seg = segments[span.id];
+        uint64_t segStart = span.start;
+        uint64_t segEnd = span.end;
+        uint64_t first = std::max(firstCell, segStart / framesPerCell);
+        uint64_t last = std::min(endCell, (segEnd + framesPerCell - 1) / framesPerCell);
+        const PeakFile* peakFile = peaks.get(seg.filename);
+        if (!peakFile) {
+            markLaneCells(lane, firstCell, framesPerCell, segStart, segEnd, 'x');
+            return;
+        }
+        // peaks cover the whole file, the segment may only use part of it
+        uint64_t offset = (uint64_t)seg.sourceOffset;
+        for (uint64_t cell = first; cell < last; cell++) {
+            uint64_t from = std::max(cell * framesPerCell, segStart) - segStart + offset;
+            uint64_t to = std::min((cell + 1) * framesPerCell, segEnd) - segStart + offset;
+            float lo, hi;
+            if (!peakFile->range(from, to, lo, hi)) continue;
+            float peak = std::max(-lo, hi);
+            lane[cell - firstCell] = kPeakGlyphs[std::min(7, (int)(peak * 8))];
+        }
+    });
+    return lane;
+}
+
+// a session's file lives in its record directory, next to its takes
+static std::string sessionFilePath(const char* recordDir, const char* sessionName) {
+    return joinPath(recordDir, std::string(sessionName) + ".cws");
+}
+
+static void runDAW(char* sessionName, char* sessionLength, char* bufferLength, char* recordDir, char* exportDir,
+                   std::vector<std::vector<Segment>> tracks, uint64_t journalSequence, std::string message);
+
+// opens the session in the DAW screen, with whatever its journal recovered on
+// top (edits that never made it into the snapshot, a crash included)
+static void openSession(const std::string& path) {
+    auto started = std::chrono::steady_clock::now();
+    SessionData session;
+    std::string error;
+    size_t recovered = 0;
+    if (!loadSession(path, session, error, &recovered)) {
+        printw("\nCouldn't load session: %s\n", error.c_str());
+        printw("Press any key to return...\n");
+        refresh();
+        getch();
+        return;
+    }
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    if (session.tracks.empty()) session.tracks.resize(1);
+
+    // the DAW screen still takes its settings as the strings the new session screen reads in
+    char sessionName[100];
+    char sessionLength[100];
+    char bufferLength[100];
+    char recordDir[200];
+    char exportDir[200];
+    snprintf(sessionName, sizeof(sessionName), "%s", session.name.c_str());
+    snprintf(sessionLength, sizeof(sessionLength), "%lld",
+             (long long)((session.lengthFrames + ENGINE_SAMPLE_RATE - 1) / ENGINE_SAMPLE_RATE));
+    snprintf(bufferLength, sizeof(bufferLength), "%u", session.bufferFrames);
+    snprintf(recordDir, sizeof(recordDir), "%s", session.recordDir.c_str());
+    snprintf(exportDir, sizeof(exportDir), "%s", session.exportDir.c_str());
+
+    size_t segmentCount = 0;
+    for (const auto& track : session.tracks) segmentCount += track.size();
+    char message[400];
+    snprintf(message, sizeof(message), "Loaded %s (%zu segments, %zu edits from the journal, %.1f ms)",
+             path.c_str(), segmentCount, recovered, loadMs);
+    runDAW(sessionName, sessionLength, bufferLength, recordDir, exportDir, std::move(session.tracks),
+           session.journalSequence, message);
+}
+
 void showDAWInterface(char* sessionName, char* sessionLength, char* bufferLength, char* recordDir, char* exportDir) {
-    int numTracks = 4;
-    int timelinePos = 0;
+    // the DAW screen writes a fresh snapshot and empties the journal as soon as it
+    // opens, so a session that's already there under this name has to be dealt with first
+    std::string path = sessionFilePath(recordDir, sessionName);
+    std::string journalPath = SessionJournal::journalPathFor(path);
+    bool haveSnapshot = access(path.c_str(), F_OK) == 0;
+    bool haveJournal = access(journalPath.c_str(), F_OK) == 0;
+    if (haveSnapshot || haveJournal) {
+        clear();
+        printw("A session called %s already exists in %s.\n\n", sessionName, recordDir);
+        printw("  O - Open it (recovers anything left in its journal)\n");
+        printw("  N - Start a new one in its place (the old arrangement is lost, takes stay on disk)\n");
+        printw("  Any other key - Go back\n");
+        refresh();
+        int key = getch();
+        if (key == 'o' || key == 'O') {
+            if (haveSnapshot) {
+                openSession(path);
+                return;
+            }
+            // never got as far as its first snapshot, the journal goes on top of a new session like this one
+            SessionData session;
+            session.tracks.resize(4);
+            size_t recovered = replayJournal(journalPath, session);
+            runDAW(sessionName, sessionLength, bufferLength, recordDir, exportDir, std::move(session.tracks),
+                   session.journalSequence, "Recovered " + std::to_string(recovered) + " edits from " + journalPath);
+            return;
+        }
+        if (key != 'n' && key != 'N') return;
+        // its edits must never end up on top of the new one
+        remove(journalPath.c_str());
+    }
+    runDAW(sessionName, sessionLength, bufferLength, recordDir, exportDir, std::vector<std::vector<Segment>>(4), 0, "");
+}
+
+void showLoadSessionScreen() {
+    clear();
+    printw("===== Load Session =====\n\n");
+    refresh();
+
+    char sessionPath[300];
+    printw("Enter session file (e.g., recordings/mysession.cws): ");
+    refresh(); echo(); getstr(sessionPath); noecho();
+    openSession(sessionPath);
+}
+
+static void runDAW(char* sessionName, char* sessionLength, char* bufferLength, char* recordDir, char* exportDir,
+                   std::vector<std::vector<Segment>> tracks, uint64_t journalSequence, std::string message) {
+    TRACE_THREAD_NAME("ui");
+    int numTracks = (int)tracks.size();
     int selectedTrack = 0;
     bool isPlaying = false;
     bool isRecording = false;
+    bool showStats = false;
+    CallbackTiming shownTiming = {};
     int takeCounter = 1;
     int maxTime = atoi(sessionLength);
-    int timelineWidth = maxTime * 5;
 
-    std::vector<std::vector<Segment>> trackSegments(numTracks);
+    std::vector<std::vector<Segment>> trackSegments = std::move(tracks);
+    std::vector<IntervalIndex> trackIndex(numTracks);
+    for (int t = 0; t < numTracks; t++) trackIndex[t] = indexTrack(trackSegments[t]);
+    PlaybackWindow playbackWindow;
 
-    int recStartPos = -1;
+    uint64_t recStartFrame = 0;
     int recTrackIndex = -1;
     std::string recFile;
-    int lastPlayedPos = -1;
+
+    // everything runs in sample frames. the old 5-per-second tick is only the zoom we start at
+    const uint64_t framesPerTick = ENGINE_SAMPLE_RATE / 5;
+    const uint64_t sessionFrames = (uint64_t)std::max(maxTime, 0) * ENGINE_SAMPLE_RATE;
+
+    // the playhead is a frame, the view is a window of cells at some zoom
+    uint64_t playheadFrame = 0;
+    uint64_t framesPerCell = framesPerTick;
+    uint64_t viewStartCell = 0;
+
+    // the device stays open (and running) until we leave the DAW screen.
+    // the session's buffer length is the period we ask the device for
+    AudioEngineConfig engineConfig = audio_engine_config_init();
+    engineConfig.periodSizeInFrames = (uint32_t)std::max(atoi(bufferLength), 0);
+    ma_result deviceResult = open_audio_devices(&engineConfig);
+
+    // waveform overviews of the takes, built in the background
+    PeakCache peaks;
+    // mixdowns, also in the background. whatever still runs on quit gets cancelled
+    ExportQueue exports;
+
+    // autosave, every edit below is handed to the journal and written on its thread
+    SessionJournal journal;
+    {
+        SessionData session;
+        session.name = sessionName;
+        session.lengthFrames = (int64_t)sessionFrames;
+        session.bufferFrames = (uint32_t)std::max(atoi(bufferLength), 0);
+        session.recordDir = recordDir;
+        session.exportDir = exportDir;
+        session.tracks = trackSegments;
+        session.journalSequence = journalSequence;
+        ensureDir(recordDir);
+        journal.start(session, sessionFilePath(recordDir, sessionName));
+    }
+
+    // closes the take and puts it on its track where the engine says it started
+    auto finishTake = [&]() {
+        if (!isRecording) return;
+        stop_recording();
+        isRecording = false;
+        RecordingStats recStats;
+        get_recording_stats(&recStats);
+        if (recTrackIndex >= 0 && recTrackIndex < (int)trackSegments.size() && recStats.startFrame != UINT64_MAX) {
+            Segment seg{(int64_t)recStats.startFrame, (int64_t)recStats.framesWritten, 0, recFile};
+            trackSegments[recTrackIndex].push_back(seg);
+            journal.segmentAdded((uint32_t)recTrackIndex, seg);
+            trackIndex[recTrackIndex] = indexTrack(trackSegments[recTrackIndex]);
+            // start on its peaks right away, the lane shows 'x' until they're there
+            peaks.get(recFile);
+        }
+        recTrackIndex = -1;
+        recFile.clear();
+    };
 
     nodelay(stdscr, TRUE);
 
-    std::vector<std::vector<char>> trackData(numTracks, std::vector<char>(timelineWidth, ' '));
+    // only redraws what changed between loop iterations
+    DawScreen screen;
+
+    // the loop sleeps until a key comes in or the engine has something new. the
+    // engine pokes us once per timeline cell while the transport rolls, but not
+    // more than ~30 times a second when zoomed all the way in
+    auto setZoom = [&](uint64_t zoom) {
+        int cells = screen.timelineCells();
+        uint64_t playCell = playheadFrame / framesPerCell;
+        // keep the playhead in the same column
+        uint64_t column = (playCell >= viewStartCell && playCell < viewStartCell + cells) ? playCell - viewStartCell : cells / 2;
+        framesPerCell = zoom;
+        playCell = playheadFrame / framesPerCell;
+        viewStartCell = playCell > column ? playCell - column : 0;
+        if (deviceResult == MA_SUCCESS) set_engine_notify_interval(std::max<uint64_t>(framesPerCell, ENGINE_SAMPLE_RATE / 30));
+    };
+    setZoom(framesPerTick);
+    UiEventLoop events;
+    events.watch(get_engine_event_fd(), UI_EVENT_ENGINE);
+    events.watch(peaks.eventFd(), UI_EVENT_PEAKS);
+    events.watch(exports.eventFd(), UI_EVENT_EXPORT);
+
+    // queues a mixdown of [startFrame, endFrame) of the session, end < 0 is the end
+    auto queueExport = [&](const std::string& suffix, MixdownFormat format, int64_t startFrame, int64_t endFrame) {
+        ensureDir(exportDir);
+        std::string outPath = joinPath(exportDir, std::string(sessionName) + "_mixdown" + suffix + ".wav");
+        if (exports.submit(trackSegments, (int64_t)sessionFrames, outPath, format, startFrame, endFrame) < 0) {
+            message = "Already exporting " + outPath;
+        } else {
+            message = "Exporting " + outPath;
+        }
+    };
 
     while (true) {
-        clear();
+        // only the cells that fit on the terminal get looked at below
+        int cells = screen.timelineCells();
+        uint64_t wholeSession = std::max<uint64_t>(1, (sessionFrames + cells - 1) / std::max(cells, 1));
+        uint64_t sessionCells = (sessionFrames + framesPerCell - 1) / framesPerCell;
+        uint64_t playCell = playheadFrame / framesPerCell;
+        if (playCell < viewStartCell) {
+            viewStartCell = playCell;
+        } else if (cells > 0 && playCell >= viewStartCell + cells) {
+            // while rolling the view pages along, moving by hand it scrolls
+            viewStartCell = transport_is_rolling() ? playCell : playCell - cells + 1;
+        }
+        viewStartCell = std::min(viewStartCell, sessionCells > (uint64_t)cells ? sessionCells - cells : 0);
+
         std::string headerLine(60, '=');
-        printw("%s\n", headerLine.c_str());
-        printw("CLIWave DAW - Session: %s | Length: %ss | Buffer: %s\n", 
-               sessionName, sessionLength, bufferLength);
-        printw("%s\n", headerLine.c_str());
-        
-        printw("\nPlayback: ");
-        if (isPlaying) {
-            attron(A_BOLD);
-            printw("[PLAYING] ");
-            attroff(A_BOLD);
+        char line[512];
+        DawView view;
+
+        view.status.push_back({headerLine, A_NORMAL});
+        snprintf(line, sizeof(line), "CLIWave DAW - Session: %s | Length: %ss | Buffer: %s",
+                 sessionName, sessionLength, bufferLength);
+        view.status.push_back({line, A_NORMAL});
+        view.status.push_back({headerLine, A_NORMAL});
+        view.status.push_back({"", A_NORMAL});
+
+        snprintf(line, sizeof(line), "Playback: %s%sTime: %.1f s | Zoom: %s/cell", isPlaying ? "[PLAYING] " : "[STOPPED] ",
+                 isRecording ? "[REC]" : "", double(playheadFrame) / ENGINE_SAMPLE_RATE, formatZoom(framesPerCell).c_str());
+        view.status.push_back({line, (isPlaying || isRecording) ? A_BOLD : A_NORMAL});
+
+        if (deviceResult != MA_SUCCESS) {
+            snprintf(line, sizeof(line), "No audio device (code %d)", deviceResult);
         } else {
-            printw("[STOPPED] ");
+            LatencyInfo latency;
+            get_latency_info(&latency);
+            int n = snprintf(line, sizeof(line), "Period: %u x %u frames (callback %u, max %u) | Out: %.1f ms",
+                             latency.playbackPeriodFrames, latency.playbackPeriods,
+                             latency.lastCallbackFrames, latency.maxCallbackFrames, latency.outputLatencyMs);
+            if (latency.capturePeriodFrames > 0) snprintf(line + n, sizeof(line) - n, " | In: %.1f ms", latency.inputLatencyMs);
+        }
+        view.status.push_back({line, A_NORMAL});
+
+        // rows stay put whether or not there's something in them, so nothing below has to move
+        line[0] = '\0';
+        if (isPlaying) {
+            PlaybackStats playStats;
+            get_playback_stats(&playStats);
+            snprintf(line, sizeof(line), "Streaming: %u sources (%u queued) | Min buffered: %.2f s | Underruns: %u (%llu frames)",
+                     playStats.streamingSources, playStats.queuedSources,
+                     double(playStats.minBufferedFrames) / ENGINE_SAMPLE_RATE, playStats.underrunCount,
+                     (unsigned long long)playStats.underrunFrames);
         }
+        view.status.push_back({line, A_NORMAL});
+
+        line[0] = '\0';
         if (isRecording) {
-            attron(A_BOLD | COLOR_PAIR(1));
-            printw("[REC]");
-            attroff(A_BOLD | COLOR_PAIR(1));
+            RecordingStats recStats;
+            get_recording_stats(&recStats);
+            snprintf(line, sizeof(line), "Input buffer: %u/%u frames | Overruns: %u (%llu frames dropped)",
+                     recStats.ringFill, recStats.ringCapacity, recStats.overrunCount,
+                     (unsigned long long)recStats.overrunFrames);
         }
-        printw("Time: %.1f s\n", float(timelinePos)/5);
-        
-        printw("\nSeconds:  |");
-        for (int s = 0; s < maxTime; s++) {
-            if (s % 10 == 0) {
-                printw("%d", s);
-            } else {
-                printw(" ");
-            }
-            for (int i = 1; i < 5; i++) {
-                printw(" ");
-            }
+        view.status.push_back({line, A_NORMAL});
+        if (showStats && deviceResult == MA_SUCCESS) {
+            CallbackTiming timing;
+            get_callback_timing(&timing);
+            engineStatsLines(timing, shownTiming, view.status);
+            shownTiming = timing;
         }
-        printw("|\n");
-        
-        printw("Timeline: |");
-        for (int i = 0; i < timelineWidth; i++) {
-            if (i == timelinePos) {
-                attron(A_REVERSE);
-                printw(">");
-                attroff(A_REVERSE);
-            } else if (i % 5 == 0) {
-                printw("|");
+        // finished exports only show up once, as the message
+        for (const auto& job : exports.takeFinished()) {
+            char text[512];
+            if (job.state == ExportQueue::State::Done) {
+                snprintf(text, sizeof(text), "Exported: %s (%.1f s, %.1fx realtime)", job.path.c_str(),
+                         job.elapsedSeconds, job.realtime);
+            } else if (job.state == ExportQueue::State::Cancelled) {
+                snprintf(text, sizeof(text), "Export cancelled: %s", job.path.c_str());
             } else {
-                printw("-");
+                snprintf(text, sizeof(text), "Export failed: %s", job.path.c_str());
             }
+            message = text;
         }
-        printw("|\n\n");
-        
-        printw("Tracks:\n");
-        std::string trackLine(timelineWidth + 2, '-');
-        for (int i = 0; i < numTracks; i++) {
-            if (i == selectedTrack) attron(A_REVERSE);
-            printw("[Track %d] ", i + 1);
-            if (i == selectedTrack) attroff(A_REVERSE);
-            
-            printw("|");
-            for (int j = 0; j < timelineWidth; j++) {
-                printw("%c", trackData[i][j]);
-            }
-            printw("|\n");
+        exportLines(exports.jobs(), view.status);
+        view.status.push_back({message, A_NORMAL});
+
+        view.viewStartCell = viewStartCell;
+        view.framesPerCell = framesPerCell;
+        view.sessionCells = sessionCells;
+        view.sampleRate = ENGINE_SAMPLE_RATE;
+        view.playhead = (playCell >= viewStartCell && playCell < viewStartCell + cells) ? (int)(playCell - viewStartCell) : -1;
+        view.selectedTrack = selectedTrack;
+        int laneWidth = (int)std::min<uint64_t>(cells, sessionCells - viewStartCell);
+        for (size_t t = 0; t < trackSegments.size(); t++) {
+            view.lanes.push_back(laneCells(trackSegments[t], trackIndex[t], peaks, viewStartCell, laneWidth, framesPerCell));
         }
-        
-        printw("\n%s\n", trackLine.c_str());
-        
-        printw("\nControls:\n");
-        printw("  Space   - Play/Pause\n");
-        printw("  R       - Record\n");
-        printw("  S       - Stop\n");
-        printw("  Up/Down - Select track\n");
-        printw("  Left/Right - Move timeline\n");
-        printw("  M       - Mute selected track\n");
-        printw("  E       - Export mixdown\n");
-        printw("  +/-     - Add/Remove track\n");
-        printw("  Q       - Quit to menu\n");
-        
-        refresh();
-        
-        int ch = getch();
-        
-        if (ch != ERR) {
+        // the take being recorded isn't a segment yet, it runs up to the playhead
+        if (isRecording && recTrackIndex >= 0 && recTrackIndex < (int)view.lanes.size()) {
+            RecordingStats recStats;
+            get_recording_stats(&recStats);
+            uint64_t takeStart = recStats.startFrame != UINT64_MAX ? recStats.startFrame : recStartFrame;
+            markLaneCells(view.lanes[recTrackIndex], viewStartCell, framesPerCell, takeStart, playheadFrame + 1, 'x');
+        }
+        TRACE_BEGIN("draw");
+        screen.draw(view);
+        TRACE_END("draw");
+
+        // the stats rows keep changing while the transport rolls (or the stats
+        // panel is up, or an export runs), so they get a slow timer then. otherwise
+        // nothing wakes us but keys
+        events.setTimer((isPlaying || isRecording || showStats || exports.busy()) ? 250 : 0);
+        TRACE_BEGIN("wait");
+        int woke = events.wait();
+        TRACE_END("wait");
+        clear_engine_events();
+        if (woke & UI_EVENT_PEAKS) peaks.clearEvents();
+        if (woke & UI_EVENT_EXPORT) exports.clearEvents();
+
+        // handle everything that queued up since the last draw
+        int ch;
+        while ((ch = getch()) != ERR) {
+            TRACE_SCOPE("key");
             switch(ch) {
                 case ' ':
                     isPlaying = !isPlaying;
-                    if (!isPlaying) {
+                    if (isPlaying) {
+                        if (startSessionPlayback(playbackWindow, trackSegments, trackIndex, playheadFrame) != MA_SUCCESS) isPlaying = false;
+                    } else {
                         stop_playback();
                     }
                     break;
                 case 'r':
                 case 'R':
                     if (!isRecording) {
+                        // recording rolls the transport from the playhead if playback isn't already
+                        bool wasRolling = transport_is_rolling();
+                        if (!wasRolling) transport_start(playheadFrame);
                         ensureDir(recordDir);
-                        std::string fname = joinPath(recordDir, std::string(sessionName) +
-                                            "_track" + std::to_string(selectedTrack + 1) +
-                                            "_take" + std::to_string(takeCounter) + ".wav");
-                        ma_result res = start_recording(fname.c_str(), ma_format_s16, 2, 44100);
+                        // a loaded session already has takes on disk, never record over one
+                        std::string fname;
+                        do {
+                            fname = joinPath(recordDir, std::string(sessionName) +
+                                    "_track" + std::to_string(selectedTrack + 1) +
+                                    "_take" + std::to_string(takeCounter) + ".wav");
+                        } while (access(fname.c_str(), F_OK) == 0 && ++takeCounter);
+                        ma_result res = start_recording(fname.c_str());
                         if (res == MA_SUCCESS) {
                             isRecording = true;
                             takeCounter++;
-                            recStartPos = timelinePos;
+                            recStartFrame = playheadFrame;
                             recTrackIndex = selectedTrack;
                             recFile = fname;
-                            move(0, 0);
-                            printw("Recording -> %s\n", fname.c_str());
+                            message = "Recording -> " + fname;
                         } else {
-                            move(0, 0);
-                            printw("Recording failed (code %d)\n", res);
+                            if (!wasRolling) transport_stop();
+                            message = "Recording failed (code " + std::to_string(res) + ")";
                         }
                     }
                     break;
                 case 's':
                 case 'S':
                     isPlaying = false;
+                    finishTake();
                     stop_playback();
-                    if (isRecording) {
-                        stop_recording();
-                        isRecording = false;
-                        if (recStartPos >= 0 && recTrackIndex >= 0) {
-                            Segment seg{recStartPos, timelinePos - recStartPos, recFile};
-                            trackSegments[recTrackIndex].push_back(seg);
-                            recStartPos = -1;
-                            recTrackIndex = -1;
-                            recFile.clear();
-                        }
-                    }
-                    timelinePos = 0;
+                    transport_stop();
+                    transport_locate(0);
+                    playheadFrame = 0;
                     break;
                 case KEY_UP:
                     if (selectedTrack > 0) selectedTrack--;
@@ -286,157 +650,128 @@ void showDAWInterface(char* sessionName, char* sessionLength, char* bufferLength
                     if (selectedTrack < numTracks - 1) selectedTrack++;
                     break;
                 case KEY_LEFT:
-                    if (timelinePos > 0) timelinePos--;
+                    playCell = playheadFrame / framesPerCell;
+                    playheadFrame = playCell > 0 ? (playCell - 1) * framesPerCell : 0;
                     break;
                 case KEY_RIGHT:
-                    if (timelinePos < timelineWidth - 1) timelinePos++;
+                    playCell = playheadFrame / framesPerCell;
+                    if ((playCell + 1) * framesPerCell < sessionFrames) playheadFrame = (playCell + 1) * framesPerCell;
+                    break;
+                case KEY_PPAGE:
+                    playCell = playheadFrame / framesPerCell;
+                    playheadFrame = playCell > (uint64_t)cells ? (playCell - cells) * framesPerCell : 0;
+                    viewStartCell = viewStartCell > (uint64_t)cells ? viewStartCell - cells : 0;
+                    break;
+                case KEY_NPAGE:
+                    playCell = playheadFrame / framesPerCell;
+                    if (sessionCells > 0) playheadFrame = std::min(playCell + cells, sessionCells - 1) * framesPerCell;
+                    viewStartCell += cells;
+                    break;
+                case KEY_HOME:
+                    playheadFrame = 0;
+                    break;
+                case KEY_END:
+                    if (sessionCells > 0) playheadFrame = (sessionCells - 1) * framesPerCell;
+                    break;
+                case '[':
+                    setZoom(zoomOut(framesPerCell, wholeSession));
+                    sessionCells = (sessionFrames + framesPerCell - 1) / framesPerCell;
+                    break;
+                case ']':
+                    setZoom(zoomIn(framesPerCell));
+                    sessionCells = (sessionFrames + framesPerCell - 1) / framesPerCell;
                     break;
                 case '+':
                     if (numTracks < 8) {
                         numTracks++;
-                        trackData.push_back(std::vector<char>(timelineWidth, ' '));
                         trackSegments.push_back(std::vector<Segment>());
+                        trackIndex.push_back(IntervalIndex());
+                        journal.trackAdded();
                     }
                     break;
                 case '-':
                     if (numTracks > 1) {
                         numTracks--;
-                        if (!trackData.empty()) trackData.pop_back();
                         if (!trackSegments.empty()) trackSegments.pop_back();
+                        if (!trackIndex.empty()) trackIndex.pop_back();
+                        journal.trackRemoved();
                         if (selectedTrack >= numTracks) selectedTrack = numTracks - 1;
                     }
                     break;
                 case 'e':
-                case 'E': {
-                    move(0, 0);
-                    printw("Exporting...\n");
-                    refresh();
-                    ensureDir(exportDir);
-                    std::string outPath = joinPath(exportDir, std::string(sessionName) + "_mixdown.wav");
-                    bool ok = mixdownAllTracks(trackSegments, maxTime, outPath);
-                    if (ok) {
-                        printw("Exported: %s\n", outPath.c_str());
-                    } else {
-                        printw("Export failed.\n");
-                    }
+                case 'E':
+                    queueExport("", MixdownFormat::S16, 0, -1);
+                    break;
+                case 'f':
+                case 'F':
+                    queueExport("_f32", MixdownFormat::F32, 0, -1);
+                    break;
+                case 'x':
+                case 'X': {
+                    char suffix[32];
+                    snprintf(suffix, sizeof(suffix), "_from_%.1fs", double(playheadFrame) / ENGINE_SAMPLE_RATE);
+                    queueExport(suffix, MixdownFormat::S16, (int64_t)playheadFrame, -1);
                     break;
                 }
+                case 'c':
+                case 'C': {
+                    int id = exports.newestActive();
+                    message = (id >= 0 && exports.cancel(id)) ? "Cancelling export " + std::to_string(id)
+                                                              : "No export to cancel";
+                    break;
+                }
+                case 'w':
+                case 'W':
+                    // a take that's still recording isn't in it until it's stopped
+                    journal.compact();
+                    message = "Saving " + sessionFilePath(recordDir, sessionName);
+                    break;
+                case 't':
+                case 'T':
+                    showStats = !showStats;
+                    if (showStats && deviceResult == MA_SUCCESS) get_callback_timing(&shownTiming);
+                    break;
+                case 'p':
+                case 'P': {
+                    std::string tracePath = joinPath(recordDir, std::string(sessionName) + "_trace.json");
+                    message = trace_dump(tracePath.c_str()) ? "Trace written to " + tracePath
+                                                            : "No trace (build with -DCLIWAVE_TRACE=ON)";
+                    break;
+                }
+                case 12: // ctrl-l
+                    screen.invalidate();
+                    break;
                 case 'q':
                 case 'Q':
-                    if (isRecording) {
-                        stop_recording();
-                        isRecording = false;
-                        if (recStartPos >= 0 && recTrackIndex >= 0) {
-                            Segment seg{recStartPos, timelinePos - recStartPos, recFile};
-                            trackSegments[recTrackIndex].push_back(seg);
-                        }
-                    }
+                    finishTake();
+                    // the one place that waits for the disk, so nothing queued gets lost
+                    journal.close();
                     stop_playback();
+                    // what the callback did this whole time, for picking a buffer length on this machine
+                    if (deviceResult == MA_SUCCESS) {
+                        dump_engine_telemetry(joinPath(recordDir, std::string(sessionName) + "_engine.json").c_str());
+                    }
+                    // does nothing unless tracing is compiled in
+                    trace_dump(joinPath(recordDir, std::string(sessionName) + "_trace.json").c_str());
+                    close_audio_devices();
                     nodelay(stdscr, FALSE);
                     return;
             }
         }
-        
-        // recording with timeline logic (WIP)
-
-        if (isPlaying || isRecording) {
-            napms(200);
-            if (timelinePos < timelineWidth - 1) {
-                if (isRecording) {
-                    trackData[selectedTrack][timelinePos] = 'x';
-                }
-                if (isPlaying && lastPlayedPos != timelinePos) {
-                    for (const auto& seg : trackSegments[selectedTrack]) {
-                        if (seg.startPos == timelinePos) {
-                            start_playback(seg.filename.c_str());
-                            break;
-                        }
-                    }
-                    lastPlayedPos = timelinePos;
-                }
-                timelinePos++;
+
+        // the audio callback moves the transport, we only follow it to draw the playhead
+        if (transport_is_rolling()) {
+            uint64_t position = get_transport_position();
+            if (position < sessionFrames) {
+                playheadFrame = position;
+                if (isPlaying) updateSessionPlayback(playbackWindow, trackSegments, trackIndex, position);
             } else {
-                if (isRecording) {
-                    stop_recording();
-                    isRecording = false;
-                    if (recStartPos >= 0 && recTrackIndex >= 0) {
-                        Segment seg{recStartPos, timelinePos - recStartPos, recFile};
-                        trackSegments[recTrackIndex].push_back(seg);
-                        recStartPos = -1;
-                        recTrackIndex = -1;
-                        recFile.clear();
-                    }
-                }
+                finishTake();
                 stop_playback();
+                transport_stop();
                 isPlaying = false;
+                playheadFrame = sessionFrames > 0 ? sessionFrames - 1 : 0;
             }
-        } else {
-            napms(50);
         }
     }
 }
-
-static bool mixdownAllTracks(const std::vector<std::vector<Segment>>& trackSegments, int maxTimeSeconds, const std::string& exportPath) {
-
-    // later I will make this modifiable, can't be very hard.
-    const int sampleRate = 44100;
-    const int channels = 2;
-    const int ticksPerSecond = 5;
-    const int totalFrames = maxTimeSeconds * sampleRate;
-
-    std::vector<float> mix(channels * totalFrames, 0.0f);
-
-    for (size_t t = 0; t < trackSegments.size(); ++t) {
-        for (const auto& seg : trackSegments[t]) {
-            // start offset in frames
-            int startFrame = (seg.startPos * sampleRate) / ticksPerSecond;
-            ma_decoder dec;
-            if (ma_decoder_init_file(seg.filename.c_str(), nullptr, &dec) != MA_SUCCESS) continue;
-            std::vector<float> buf(1024 * channels);
-            ma_uint64 totalRead = 0;
-
-            while (true) {
-                ma_uint64 got = 0;
-                ma_result r = ma_decoder_read_pcm_frames(&dec, buf.data(), 1024, &got);
-                if (r != MA_SUCCESS || got == 0) break;
-                for (ma_uint64 i = 0; i < got; ++i) {
-                    int dstFrame = startFrame + static_cast<int>(i);
-                    if (dstFrame >= totalFrames) break;
-                    for (int c = 0; c < channels; ++c) {
-                        size_t dstIdx = static_cast<size_t>(dstFrame) * channels + c;
-                        mix[dstIdx] += buf[i * channels + c];
-                    }
-                }
-                totalRead += got;
-                if (totalRead >= seg.length * sampleRate / ticksPerSecond) break;
-            }
-            ma_decoder_uninit(&dec);
-        }
-    }
-    float maxAbs = 0.0f;
-    for (float v : mix) maxAbs = std::max(maxAbs, std::fabs(v));
-    float scale = (maxAbs > 1.0f) ? (1.0f / maxAbs) : 1.0f;
-
-    ma_encoder_config encCfg = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, channels, sampleRate);
-    ma_encoder enc;
-    if (ma_encoder_init_file(exportPath.c_str(), &encCfg, &enc) != MA_SUCCESS) {
-        return false;
-    }
-
-    std::vector<int16_t> outBlock(1024 * channels);
-    size_t frame = 0;
-    while (frame < static_cast<size_t>(totalFrames)) {
-        size_t chunk = std::min(outBlock.size() / channels, static_cast<size_t>(totalFrames) - frame);
-        for (size_t i = 0; i < chunk; ++i) {
-            for (int c = 0; c < channels; ++c) {
-                float v = mix[(frame + i)*channels + c] * scale;
-                v = std::max(-1.0f, std::min(1.0f, v));
-                outBlock[i * channels + c] = static_cast<int16_t>(v * 32767.0f);
-            }
-        }
-        ma_encoder_write_pcm_frames(&enc, outBlock.data(), chunk, nullptr);
-        frame += chunk;
-    }
-    ma_encoder_uninit(&enc);
-    return true;
-}
\ No newline at end of file
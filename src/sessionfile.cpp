@@ -0,0 +1,280 @@
+#include "sessionfile.hpp"
+#include "audiomanager.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// all offsets are from the start of the file and 8 byte aligned, so every
+// array can be used straight out of the mapping
+struct SessionHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t sampleRate;
+    uint32_t bufferFrames;
+    int64_t lengthFrames;
+    uint32_t name;       // string table offsets
+    uint32_t recordDir;
+    uint32_t exportDir;
+    uint32_t trackCount;
+    uint64_t tracksOffset;
+    uint64_t segmentsOffset;
+    uint64_t segmentCount;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t journalSequence;
+};
+
+// a track is a run of the segment array
+struct TrackRecord {
+    uint64_t firstSegment;
+    uint64_t segmentCount;
+};
+
+static const char kSessionMagic[8] = {'C', 'W', 'S', 'E', 'S', 'S', '\0', '\0'};
+static const uint32_t kSessionVersion = 2;
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+SessionFile::~SessionFile() {
+    if (map) munmap(map, mapSize);
+}
+
+const SessionHeader* SessionFile::header() const {
+    return (const SessionHeader*)map;
+}
+
+bool SessionFile::open(const std::string& path) {
+    if (map) munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    lastError.clear();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        lastError = "can't open " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SessionHeader)) {
+        close(fd);
+        lastError = "not a session file";
+        return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        lastError = "can't map " + path;
+        return false;
+    }
+    map = data;
+    mapSize = st.st_size;
+
+    // only the header and the tables' bounds get checked, the records are used as they are
+    const SessionHeader* h = header();
+    uint64_t size = mapSize;
+    if (memcmp(h->magic, kSessionMagic, 8) != 0) {
+        lastError = "not a session file";
+    } else if (h->version != kSessionVersion || h->headerSize != sizeof(SessionHeader)) {
+        lastError = "unsupported session version " + std::to_string(h->version);
+    } else if (h->sampleRate != ENGINE_SAMPLE_RATE) {
+        lastError = "session is at " + std::to_string(h->sampleRate) + " Hz";
+    } else if (h->tracksOffset > size || h->trackCount > (size - h->tracksOffset) / sizeof(TrackRecord) ||
+               h->segmentsOffset > size || h->segmentCount > (size - h->segmentsOffset) / sizeof(SegmentRecord) ||
+               h->stringsOffset > size || h->stringsSize == 0 || h->stringsSize > size - h->stringsOffset ||
+               ((const char*)map)[h->stringsOffset + h->stringsSize - 1] != '\0') {
+        lastError = "session file is damaged";
+    } else {
+        const TrackRecord* tracks = (const TrackRecord*)((const char*)map + h->tracksOffset);
+        for (uint32_t t = 0; t < h->trackCount; t++) {
+            if (tracks[t].firstSegment > h->segmentCount || tracks[t].segmentCount > h->segmentCount - tracks[t].firstSegment) {
+                lastError = "session file is damaged";
+                break;
+            }
+        }
+        if (lastError.empty()) return true;
+    }
+
+    munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    return false;
+}
+
+const char* SessionFile::string(uint32_t offset) const {
+    if (!map || offset >= header()->stringsSize) return "";
+    // the table ends in a '\0' (checked in open), so this is always terminated
+    return (const char*)map + header()->stringsOffset + offset;
+}
+
+const char* SessionFile::name() const { return map ? string(header()->name) : ""; }
+const char* SessionFile::recordDir() const { return map ? string(header()->recordDir) : ""; }
+const char* SessionFile::exportDir() const { return map ? string(header()->exportDir) : ""; }
+int64_t SessionFile::lengthFrames() const { return map ? header()->lengthFrames : 0; }
+uint32_t SessionFile::bufferFrames() const { return map ? header()->bufferFrames : 0; }
+uint32_t SessionFile::trackCount() const { return map ? header()->trackCount : 0; }
+uint64_t SessionFile::journalSequence() const { return map ? header()->journalSequence : 0; }
+
+const SessionFile::SegmentRecord* SessionFile::segments(uint32_t track, uint64_t& count) const {
+    count = 0;
+    if (!map || track >= header()->trackCount) return nullptr;
+    const TrackRecord& rec = ((const TrackRecord*)((const char*)map + header()->tracksOffset))[track];
+    count = rec.segmentCount;
+    return (const SegmentRecord*)((const char*)map + header()->segmentsOffset) + rec.firstSegment;
+}
+
+void SessionFile::load(SessionData& session) const {
+    session.name = name();
+    session.lengthFrames = lengthFrames();
+    session.bufferFrames = bufferFrames();
+    session.recordDir = recordDir();
+    session.exportDir = exportDir();
+    session.journalSequence = journalSequence();
+    session.tracks.assign(trackCount(), std::vector<Segment>());
+    for (uint32_t t = 0; t < trackCount(); t++) {
+        uint64_t count;
+        const SegmentRecord* records = segments(t, count);
+        std::vector<Segment>& track = session.tracks[t];
+        track.reserve(count);
+        for (uint64_t i = 0; i < count; i++) {
+            const SegmentRecord& rec = records[i];
+            track.push_back(Segment{rec.startFrame, rec.frameCount, rec.sourceOffset, string(rec.filename)});
+        }
+    }
+}
+
+static std::string parentDir(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) return ".";
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// absolute, with the "." and ".." parts taken out (just by the text, symlinks aren't looked at)
+static std::string absolutePath(const std::string& path) {
+    std::string full = path;
+    if (full.empty() || full[0] != '/') {
+        char cwd[4096];
+        if (!getcwd(cwd, sizeof(cwd))) return path;
+        full = std::string(cwd) + "/" + path;
+    }
+    std::vector<std::string> parts;
+    size_t pos = 0;
+    while (pos <= full.size()) {
+        size_t next = full.find('/', pos);
+        if (next == std::string::npos) next = full.size();
+        std::string part = full.substr(pos, next - pos);
+        if (part == "..") {
+            if (!parts.empty()) parts.pop_back();
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        pos = next + 1;
+    }
+    std::string result;
+    for (const auto& part : parts) result += "/" + part;
+    return result.empty() ? "/" : result;
+}
+
+std::string sessionRelativePath(const std::string& file, const std::string& sessionPath) {
+    if (file.empty()) return file;
+    std::string dir = absolutePath(parentDir(sessionPath));
+    std::string abs = absolutePath(file);
+    if (abs == dir) return ".";
+    std::string prefix = dir == "/" ? dir : dir + "/";
+    if (abs.compare(0, prefix.size(), prefix) == 0) return abs.substr(prefix.size());
+    return abs;
+}
+
+std::string resolveSessionPath(const std::string& stored, const std::string& sessionPath) {
+    if (stored.empty() || stored[0] == '/') return stored;
+    std::string dir = parentDir(sessionPath);
+    std::string joined = stored == "." ? dir : (dir == "." ? stored : dir + "/" + stored);
+    // sessions from before paths were stored like this have them relative to
+    // wherever cliwave ran back then
+    if (access(joined.c_str(), F_OK) != 0 && access(stored.c_str(), F_OK) == 0) return stored;
+    return joined;
+}
+
+static bool syncParentDir(const std::string& path) {
+    int fd = ::open(parentDir(path).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool writeSessionFile(const SessionData& session, const std::string& path) {
+    // every distinct string once, offset 0 is the empty string
+    std::string strings(1, '\0');
+    std::map<std::string, uint32_t> stringOffsets;
+    auto intern = [&](const std::string& text) -> uint32_t {
+        if (text.empty()) return 0;
+        auto it = stringOffsets.find(text);
+        if (it != stringOffsets.end()) return it->second;
+        uint32_t offset = (uint32_t)strings.size();
+        strings.append(text.c_str(), text.size() + 1);
+        stringOffsets[text] = offset;
+        return offset;
+    };
+
+    std::vector<TrackRecord> tracks;
+    std::vector<SessionFile::SegmentRecord> segments;
+    for (const auto& track : session.tracks) {
+        TrackRecord rec = {segments.size(), track.size()};
+        tracks.push_back(rec);
+        for (const auto& seg : track) {
+            segments.push_back({seg.startFrame, seg.frameCount, seg.sourceOffset,
+                                intern(sessionRelativePath(seg.filename, path)), 0});
+        }
+    }
+
+    SessionHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kSessionMagic, 8);
+    h.version = kSessionVersion;
+    h.headerSize = sizeof(SessionHeader);
+    h.sampleRate = ENGINE_SAMPLE_RATE;
+    h.bufferFrames = session.bufferFrames;
+    h.lengthFrames = session.lengthFrames;
+    h.name = intern(session.name);
+    h.recordDir = intern(sessionRelativePath(session.recordDir, path));
+    h.exportDir = intern(sessionRelativePath(session.exportDir, path));
+    h.trackCount = (uint32_t)tracks.size();
+    h.tracksOffset = align8(sizeof(h));
+    h.segmentsOffset = align8(h.tracksOffset + tracks.size() * sizeof(TrackRecord));
+    h.segmentCount = segments.size();
+    h.stringsOffset = align8(h.segmentsOffset + segments.size() * sizeof(SessionFile::SegmentRecord));
+    h.stringsSize = strings.size();
+    h.journalSequence = session.journalSequence;
+
+    std::string tmpPath = path + ".tmp";
+    FILE* out = fopen(tmpPath.c_str(), "wb");
+    if (!out) return false;
+    static const char zeros[8] = {0};
+    uint64_t written = 0;
+    auto put = [&](uint64_t offset, const void* data, size_t size) {
+        if (offset > written) fwrite(zeros, 1, offset - written, out);
+        if (size > 0) fwrite(data, 1, size, out);
+        written = offset + size;
+    };
+    put(0, &h, sizeof(h));
+    put(h.tracksOffset, tracks.data(), tracks.size() * sizeof(TrackRecord));
+    put(h.segmentsOffset, segments.data(), segments.size() * sizeof(SessionFile::SegmentRecord));
+    put(h.stringsOffset, strings.data(), strings.size());
+    // on disk before the rename, or a power cut can leave an empty file under the real name
+    bool ok = !ferror(out) && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    // and the rename itself only sticks once the directory is synced
+    return syncParentDir(path);
+}
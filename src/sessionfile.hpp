@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// everything is in sample frames at the engine rate. sourceOffset is where in the
+// file the segment starts, so a trimmed take is still the same file on disk
+class Segment {public: int64_t startFrame; int64_t frameCount; int64_t sourceOffset; std::string filename;};
+
+// what a session is, apart from the audio files themselves
+struct SessionData {
+    std::string name;
+    int64_t lengthFrames = 0;
+    uint32_t bufferFrames = 0;
+    std::string recordDir;
+    std::string exportDir;
+    std::vector<std::vector<Segment>> tracks;
+    uint64_t journalSequence = 0; // last journal record folded into this (see sessionjournal.hpp)
+};
+
+// a .cws file mapped into memory. the file is laid out the way it's used: a
+// fixed header, a track table, one flat array of segment records (each track
+// is a run of it) and a string table the records point into. opening only
+// checks the header and the table bounds, nothing is parsed per segment
+class SessionFile {
+public:
+    // one segment exactly as it sits in the file
+    struct SegmentRecord {
+        int64_t startFrame;
+        int64_t frameCount;
+        int64_t sourceOffset;
+        uint32_t filename; // offset into the string table
+        uint32_t flags;    // unused for now, always 0
+    };
+
+    ~SessionFile();
+
+    bool open(const std::string& path);
+    const std::string& error() const { return lastError; }
+
+    const char* name() const;
+    const char* recordDir() const;
+    const char* exportDir() const;
+    int64_t lengthFrames() const;
+    uint32_t bufferFrames() const;
+    uint32_t trackCount() const;
+    uint64_t journalSequence() const;
+    // the records of one track, count is set to how many there are
+    const SegmentRecord* segments(uint32_t track, uint64_t& count) const;
+    const char* string(uint32_t offset) const;
+
+    // copies everything into the editable model the DAW screen works on
+    void load(SessionData& session) const;
+
+private:
+    const struct SessionHeader* header() const;
+
+    void* map = nullptr;
+    size_t mapSize = 0;
+    std::string lastError;
+};
+
+// take paths in a session file (and its journal) are relative to the directory
+// the .cws is in, or absolute for anything outside it, so a session opens from
+// wherever cliwave runs. in memory they're whatever the engine can open
+std::string sessionRelativePath(const std::string& file, const std::string& sessionPath);
+std::string resolveSessionPath(const std::string& stored, const std::string& sessionPath);
+
+// writes the session in the format above, through a temp file that's synced
+// before it's renamed over the old one (and the directory after), so neither a
+// crash nor a power cut leaves a half-written one behind. true once it's on disk
+bool writeSessionFile(const SessionData& session, const std::string& path);
@@ -0,0 +1,250 @@
+#include "sessionjournal.hpp"
+#include "trace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+// the journal is this header followed by records, each one a JournalRecord and
+// its payload. only a segment has a payload: start, length and offset, then the file name
+struct JournalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t baseSequence; // the snapshot it was started from
+};
+
+struct JournalRecord {
+    uint32_t type;
+    uint32_t size;     // payload bytes after this
+    uint64_t sequence;
+    uint32_t checksum; // of everything else in the record, a torn write won't match
+    uint32_t track;
+};
+
+static const char kJournalMagic[8] = {'C', 'W', 'J', 'R', 'N', 'L', '\0', '\0'};
+static const uint32_t kJournalVersion = 1;
+// the journal gets folded into the snapshot after this many records
+static const uint64_t kCompactRecords = 256;
+
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+static uint32_t recordChecksum(const JournalRecord& rec, const char* payload) {
+    uint32_t hash = 2166136261u;
+    hash = fnv1a(hash, &rec.type, sizeof(rec.type));
+    hash = fnv1a(hash, &rec.size, sizeof(rec.size));
+    hash = fnv1a(hash, &rec.sequence, sizeof(rec.sequence));
+    hash = fnv1a(hash, &rec.track, sizeof(rec.track));
+    return fnv1a(hash, payload, rec.size);
+}
+
+static bool writeAll(int fd, const void* data, size_t size) {
+    const char* bytes = (const char*)data;
+    while (size > 0) {
+        ssize_t n = write(fd, bytes, size);
+        if (n < 0) return false;
+        bytes += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// same as the ui did it, so the replica (and a replay) ends up where the ui is
+static void applyEdit(SessionData& session, uint32_t type, uint32_t track, Segment segment) {
+    if (type == SessionJournal::EDIT_SEGMENT_ADDED) {
+        if (track < session.tracks.size()) session.tracks[track].push_back(std::move(segment));
+    } else if (type == SessionJournal::EDIT_TRACK_ADDED) {
+        session.tracks.emplace_back();
+    } else if (type == SessionJournal::EDIT_TRACK_REMOVED) {
+        if (!session.tracks.empty()) session.tracks.pop_back();
+    }
+}
+
+std::string SessionJournal::journalPathFor(const std::string& snapshotPath) {
+    std::string base = snapshotPath;
+    if (base.size() > 4 && base.compare(base.size() - 4, 4, ".cws") == 0) base.resize(base.size() - 4);
+    return base + ".cwj";
+}
+
+SessionJournal::~SessionJournal() {
+    close();
+}
+
+void SessionJournal::start(const SessionData& session, const std::string& path) {
+    close();
+    replica = session;
+    snapshotPath = path;
+    journalPath = journalPathFor(path);
+    nextSequence = session.journalSequence;
+    stopping = false;
+    compactRequested = false;
+    writer = std::thread(&SessionJournal::writerThread, this);
+}
+
+void SessionJournal::push(Edit edit) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!writer.joinable()) return;
+        edit.sequence = ++nextSequence;
+        queue.push_back(std::move(edit));
+    }
+    wake.notify_one();
+}
+
+void SessionJournal::segmentAdded(uint32_t track, const Segment& seg) {
+    push(Edit{EDIT_SEGMENT_ADDED, 0, track, seg});
+}
+
+void SessionJournal::trackAdded() {
+    push(Edit{EDIT_TRACK_ADDED, 0, 0, Segment{0, 0, 0, std::string()}});
+}
+
+void SessionJournal::trackRemoved() {
+    push(Edit{EDIT_TRACK_REMOVED, 0, 0, Segment{0, 0, 0, std::string()}});
+}
+
+void SessionJournal::compact() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        compactRequested = true;
+    }
+    wake.notify_one();
+}
+
+void SessionJournal::close() {
+    if (!writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+// the replica becomes the snapshot, then the journal starts over from it. the
+// journal is only emptied once the snapshot is safely on disk, if it can't be
+// written the journal just keeps growing
+bool SessionJournal::writeSnapshot() {
+    if (!writeSessionFile(replica, snapshotPath)) return false;
+    if (journalFd < 0) return true;
+
+    JournalHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kJournalMagic, 8);
+    header.version = kJournalVersion;
+    header.baseSequence = replica.journalSequence;
+    bool ok = ftruncate(journalFd, 0) == 0 && writeAll(journalFd, &header, sizeof(header)) && fdatasync(journalFd) == 0;
+    journalRecords = 0;
+    return ok;
+}
+
+void SessionJournal::writerThread() {
+    TRACE_THREAD_NAME("journal writer");
+    journalFd = ::open(journalPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    writeSnapshot();
+
+    std::vector<char> buffer;
+    while (true) {
+        std::deque<Edit> batch;
+        bool compactNow, stopNow;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || compactRequested || !queue.empty(); });
+            batch.swap(queue);
+            compactNow = compactRequested;
+            stopNow = stopping;
+            compactRequested = false;
+        }
+
+        // one write (and one sync) for everything that queued up since last time
+        buffer.clear();
+        for (Edit& edit : batch) {
+            JournalRecord rec;
+            rec.type = edit.type;
+            rec.sequence = edit.sequence;
+            rec.track = edit.track;
+            std::vector<char> payload;
+            if (edit.type == EDIT_SEGMENT_ADDED) {
+                const Segment& seg = edit.segment;
+                // relative to the journal's directory, same as in the snapshot
+                std::string filename = sessionRelativePath(seg.filename, journalPath);
+                payload.resize(3 * sizeof(int64_t) + filename.size());
+                memcpy(payload.data(), &seg.startFrame, sizeof(int64_t));
+                memcpy(payload.data() + 8, &seg.frameCount, sizeof(int64_t));
+                memcpy(payload.data() + 16, &seg.sourceOffset, sizeof(int64_t));
+                memcpy(payload.data() + 24, filename.data(), filename.size());
+            }
+            rec.size = (uint32_t)payload.size();
+            rec.checksum = recordChecksum(rec, payload.data());
+            buffer.insert(buffer.end(), (const char*)&rec, (const char*)&rec + sizeof(rec));
+            buffer.insert(buffer.end(), payload.begin(), payload.end());
+
+            replica.journalSequence = edit.sequence;
+            applyEdit(replica, edit.type, edit.track, std::move(edit.segment));
+            journalRecords++;
+        }
+        if (!buffer.empty() && journalFd >= 0) {
+            TRACE_SCOPE("journal write");
+            writeAll(journalFd, buffer.data(), buffer.size());
+            fdatasync(journalFd);
+        }
+
+        if (compactNow || stopNow || journalRecords >= kCompactRecords) {
+            TRACE_SCOPE("write snapshot");
+            writeSnapshot();
+        }
+        if (stopNow) break;
+    }
+
+    if (journalFd >= 0) ::close(journalFd);
+    journalFd = -1;
+}
+
+size_t replayJournal(const std::string& path, SessionData& session) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) return 0;
+    std::vector<char> data;
+    char chunk[65536];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), in)) > 0) data.insert(data.end(), chunk, chunk + got);
+    fclose(in);
+
+    JournalHeader header;
+    if (data.size() < sizeof(header)) return 0;
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, kJournalMagic, 8) != 0 || header.version != kJournalVersion) return 0;
+    // started from a later snapshot than this one, it belongs to some other session
+    if (header.baseSequence > session.journalSequence) return 0;
+
+    size_t applied = 0;
+    size_t pos = sizeof(header);
+    while (data.size() - pos >= sizeof(JournalRecord)) {
+        JournalRecord rec;
+        memcpy(&rec, data.data() + pos, sizeof(rec));
+        const char* payload = data.data() + pos + sizeof(rec);
+        if (rec.size > data.size() - pos - sizeof(rec) || recordChecksum(rec, payload) != rec.checksum) break;
+        pos += sizeof(rec) + rec.size;
+
+        // already in the snapshot (crashed between writing it and emptying the journal)
+        if (rec.sequence <= session.journalSequence) continue;
+
+        Segment seg{0, 0, 0, std::string()};
+        if (rec.type == SessionJournal::EDIT_SEGMENT_ADDED) {
+            if (rec.size < 24) break;
+            memcpy(&seg.startFrame, payload, sizeof(int64_t));
+            memcpy(&seg.frameCount, payload + 8, sizeof(int64_t));
+            memcpy(&seg.sourceOffset, payload + 16, sizeof(int64_t));
+            seg.filename = resolveSessionPath(std::string(payload + 24, rec.size - 24), path);
+        }
+        applyEdit(session, rec.type, rec.track, std::move(seg));
+        session.journalSequence = rec.sequence;
+        applied++;
+    }
+    return applied;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "sessionfile.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// autosave. every edit on the DAW screen becomes a small record that a
+// background thread appends to the journal (<name>.cwj next to <name>.cws).
+// the thread keeps its own copy of the session with the edits applied and
+// every so often writes that as the snapshot and starts the journal over.
+// nothing the ui calls here touches the disk or waits on the thread (apart
+// from close()).
+//
+// records are numbered, the snapshot remembers the last one it has, so a crash
+// between writing the snapshot and emptying the journal can't apply anything twice
+class SessionJournal {
+public:
+    enum EditType : uint32_t { EDIT_SEGMENT_ADDED = 1, EDIT_TRACK_ADDED = 2, EDIT_TRACK_REMOVED = 3 };
+
+    ~SessionJournal();
+
+    // takes a copy of the session as it is now, the thread starts with a fresh snapshot
+    void start(const SessionData& session, const std::string& snapshotPath);
+    void segmentAdded(uint32_t track, const Segment& seg);
+    void trackAdded();
+    void trackRemoved();
+    // fold the journal into the snapshot as soon as the thread gets to it
+    void compact();
+    // writes out whatever is still queued, compacts and stops the thread
+    void close();
+
+    static std::string journalPathFor(const std::string& snapshotPath);
+
+private:
+    struct Edit {
+        EditType type;
+        uint64_t sequence;
+        uint32_t track;
+        Segment segment;
+    };
+
+    void push(Edit edit);
+    void writerThread();
+    bool writeSnapshot();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Edit> queue;
+    bool compactRequested = false;
+    bool stopping = false;
+    uint64_t nextSequence = 0;
+    std::thread writer;
+
+    // only the writer thread touches these once it runs
+    SessionData replica;
+    std::string snapshotPath;
+    std::string journalPath;
+    int journalFd = -1;
+    uint64_t journalRecords = 0;
+};
+
+// applies the journal at path on top of session (the snapshot it belongs to),
+// stopping at the first torn or damaged record. returns how many records it applied
+size_t replayJournal(const std::string& path, SessionData& session);
@@ -0,0 +1,282 @@
+#include "trace.h"
+
+#ifdef CLIWAVE_TRACE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// a buffer's events go into chunks of this many
+#define TRACE_CHUNK_EVENTS 4096
+// a buffer never has more chunks than this (about 8 MB). once they're all full the
+// oldest one gets written over, so a long session keeps its newest events
+#define TRACE_BUFFER_CHUNKS 64
+#define TRACE_MAX_THREAD_NAMES 1024
+
+typedef struct {
+    uint64_t ns;
+    const char* name;
+    int64_t value;
+    int32_t tid;
+    char phase; // 'B', 'E' or 'C' like in the json
+} TraceEvent;
+
+typedef struct TraceChunk {
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+    atomic_uint count;                  // the owning thread bumps it after writing an event
+    atomic_uint generation;             // bumped whenever the chunk gets written over
+} TraceChunk;
+
+// a buffer belongs to one thread at a time. when that thread exits the buffer is
+// retired and the next new thread takes it over, so every export job and the
+// workers each mixdown starts don't leave a buffer behind per thread. nothing is
+// ever freed, the events of threads that are gone still show up in the dump
+typedef struct TraceBuffer {
+    // a ring, the chunk being written is chunks[(started - 1) % TRACE_BUFFER_CHUNKS]
+    _Atomic(TraceChunk*) chunks[TRACE_BUFFER_CHUNKS];
+    atomic_uint started;                // chunks ever started, only the owner bumps it
+    bool retired;                       // under g_lock
+    struct TraceBuffer* next;
+} TraceBuffer;
+
+static _Atomic(TraceBuffer*) g_buffers = NULL;
+// events that couldn't be recorded or got written over
+static _Atomic(uint64_t) g_droppedEvents = 0;
+
+// everything that isn't per event: taking over buffers and naming threads
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_keyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t g_bufferKey;
+static struct {
+    int32_t tid;
+    char name[32];
+} g_threadNames[TRACE_MAX_THREAD_NAMES];
+static uint32_t g_threadNameCount = 0;
+
+static _Thread_local TraceBuffer* t_buffer = NULL;
+static _Thread_local int32_t t_tid = 0;
+static _Thread_local const char* t_name = NULL;
+
+static uint64_t trace_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static TraceChunk* new_chunk()
+{
+    return (TraceChunk*)calloc(1, sizeof(TraceChunk));
+}
+
+static void retire_buffer(void* pValue)
+{
+    pthread_mutex_lock(&g_lock);
+    ((TraceBuffer*)pValue)->retired = true;
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void make_key()
+{
+    pthread_key_create(&g_bufferKey, retire_buffer);
+}
+
+static TraceBuffer* this_buffer()
+{
+    if (t_buffer != NULL) return t_buffer;
+    pthread_once(&g_keyOnce, make_key);
+    t_tid = (int32_t)syscall(SYS_gettid);
+
+    pthread_mutex_lock(&g_lock);
+    TraceBuffer* pBuffer = atomic_load_explicit(&g_buffers, memory_order_relaxed);
+    while (pBuffer != NULL && !pBuffer->retired) pBuffer = pBuffer->next;
+    if (pBuffer != NULL) {
+        pBuffer->retired = false;
+    } else {
+        pBuffer = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+        TraceChunk* pChunk = pBuffer != NULL ? new_chunk() : NULL;
+        if (pChunk != NULL) {
+            atomic_store_explicit(&pBuffer->chunks[0], pChunk, memory_order_relaxed);
+            atomic_store_explicit(&pBuffer->started, 1, memory_order_relaxed);
+        } else {
+            free(pBuffer);
+            pBuffer = NULL;
+        }
+        if (pBuffer != NULL) {
+            // new ones go on the front, the dump only ever walks the list
+            pBuffer->next = atomic_load_explicit(&g_buffers, memory_order_relaxed);
+            atomic_store_explicit(&g_buffers, pBuffer, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    if (pBuffer != NULL) pthread_setspecific(g_bufferKey, pBuffer);
+    t_buffer = pBuffer;
+    return pBuffer;
+}
+
+static void record(const char* name, char phase, int64_t value)
+{
+    TraceBuffer* pBuffer = this_buffer();
+    if (pBuffer == NULL) return;
+
+    unsigned started = atomic_load_explicit(&pBuffer->started, memory_order_relaxed);
+    TraceChunk* pChunk = atomic_load_explicit(&pBuffer->chunks[(started - 1) % TRACE_BUFFER_CHUNKS], memory_order_relaxed);
+    unsigned count = atomic_load_explicit(&pChunk->count, memory_order_relaxed);
+    if (count == TRACE_CHUNK_EVENTS) {
+        _Atomic(TraceChunk*)* pSlot = &pBuffer->chunks[started % TRACE_BUFFER_CHUNKS];
+        TraceChunk* pNext = atomic_load_explicit(pSlot, memory_order_relaxed);
+        if (pNext == NULL) {
+            pNext = new_chunk();
+            if (pNext == NULL) {
+                atomic_fetch_add_explicit(&g_droppedEvents, 1, memory_order_relaxed);
+                return;
+            }
+            atomic_store_explicit(pSlot, pNext, memory_order_release);
+        } else {
+            // the ring is full, the oldest chunk goes. a dump copying it right now
+            // sees the generation change and throws its copy away
+            atomic_fetch_add_explicit(&g_droppedEvents, atomic_load_explicit(&pNext->count, memory_order_relaxed),
+                                      memory_order_relaxed);
+            atomic_fetch_add_explicit(&pNext->generation, 1, memory_order_relaxed);
+            atomic_store_explicit(&pNext->count, 0, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+        }
+        atomic_store_explicit(&pBuffer->started, started + 1, memory_order_release);
+        pChunk = pNext;
+        count = 0;
+    }
+
+    TraceEvent* pEvent = &pChunk->events[count];
+    pEvent->ns = trace_now();
+    pEvent->name = name;
+    pEvent->value = value;
+    pEvent->tid = t_tid;
+    pEvent->phase = phase;
+    // the dump only looks at events below count, so this publishes the one above
+    atomic_store_explicit(&pChunk->count, count + 1, memory_order_release);
+}
+
+void trace_begin(const char* name)
+{
+    record(name, 'B', 0);
+}
+
+void trace_end(const char* name)
+{
+    record(name, 'E', 0);
+}
+
+void trace_counter(const char* name, int64_t value)
+{
+    record(name, 'C', value);
+}
+
+// cheap to call over and over (the callback does), only a new name takes the lock
+void trace_thread_name(const char* name)
+{
+    if (t_name == name || this_buffer() == NULL) return;
+    t_name = name;
+    pthread_mutex_lock(&g_lock);
+    uint32_t i = 0;
+    while (i < g_threadNameCount && g_threadNames[i].tid != t_tid) i++;
+    if (i < TRACE_MAX_THREAD_NAMES) {
+        g_threadNames[i].tid = t_tid;
+        snprintf(g_threadNames[i].name, sizeof(g_threadNames[i].name), "%s", name);
+        if (i == g_threadNameCount) g_threadNameCount++;
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+// copies out whatever the chunk holds, unless it gets written over meanwhile
+static bool copy_chunk(TraceChunk* pChunk, TraceEvent* pOut, unsigned* pCount)
+{
+    unsigned generation = atomic_load_explicit(&pChunk->generation, memory_order_acquire);
+    unsigned count = atomic_load_explicit(&pChunk->count, memory_order_acquire);
+    memcpy(pOut, pChunk->events, count * sizeof(TraceEvent));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&pChunk->generation, memory_order_relaxed) != generation) return false;
+    *pCount = count;
+    return true;
+}
+
+bool trace_dump(const char* path)
+{
+    // the threads keep recording while this runs, so everything is copied out first
+    TraceEvent* pEvents = NULL;
+    size_t eventCount = 0;
+    size_t capacity = 0;
+    for (TraceBuffer* pBuffer = atomic_load_explicit(&g_buffers, memory_order_acquire); pBuffer; pBuffer = pBuffer->next) {
+        unsigned started = atomic_load_explicit(&pBuffer->started, memory_order_acquire);
+        unsigned oldest = started > TRACE_BUFFER_CHUNKS ? started - TRACE_BUFFER_CHUNKS : 0;
+        for (unsigned i = oldest; i < started; ++i) {
+            TraceChunk* pChunk = atomic_load_explicit(&pBuffer->chunks[i % TRACE_BUFFER_CHUNKS], memory_order_acquire);
+            if (pChunk == NULL) continue;
+            if (capacity - eventCount < TRACE_CHUNK_EVENTS) {
+                size_t grown = capacity * 2 + TRACE_CHUNK_EVENTS;
+                TraceEvent* pGrown = (TraceEvent*)realloc(pEvents, grown * sizeof(TraceEvent));
+                if (pGrown == NULL) {
+                    free(pEvents);
+                    return false;
+                }
+                pEvents = pGrown;
+                capacity = grown;
+            }
+            unsigned count = 0;
+            if (copy_chunk(pChunk, pEvents + eventCount, &count)) eventCount += count;
+        }
+    }
+
+    FILE* pFile = fopen(path, "w");
+    if (pFile == NULL) {
+        free(pEvents);
+        return false;
+    }
+
+    // timestamps in the file are microseconds from the earliest event
+    uint64_t start = UINT64_MAX;
+    for (size_t i = 0; i < eventCount; ++i) {
+        if (pEvents[i].ns < start) start = pEvents[i].ns;
+    }
+
+    long pid = (long)getpid();
+    fprintf(pFile, "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": %llu},\n\"traceEvents\": [\n",
+            (unsigned long long)atomic_load(&g_droppedEvents));
+    fprintf(pFile, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": 0, \"args\": {\"name\": \"cliwave\"}}", pid);
+    pthread_mutex_lock(&g_lock);
+    for (uint32_t i = 0; i < g_threadNameCount; ++i) {
+        fprintf(pFile, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                pid, g_threadNames[i].tid, g_threadNames[i].name);
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    for (size_t i = 0; i < eventCount; ++i) {
+        const TraceEvent* pEvent = &pEvents[i];
+        double ts = (pEvent->ns - start) / 1000.0;
+        if (pEvent->phase == 'C') {
+            fprintf(pFile, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %ld, \"tid\": %d, \"args\": {\"value\": %lld}}",
+                    pEvent->name, ts, pid, pEvent->tid, (long long)pEvent->value);
+        } else {
+            fprintf(pFile, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %ld, \"tid\": %d}",
+                    pEvent->name, pEvent->phase, ts, pid, pEvent->tid);
+        }
+    }
+    free(pEvents);
+    fprintf(pFile, "\n]}\n");
+    return fclose(pFile) == 0;
+}
+
+#else
+
+bool trace_dump(const char* path)
+{
+    (void)path;
+    return false;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+// to ensure C compatability
+extern "C" {
+#endif
+
+// opt-in tracing, build with -DCLIWAVE_TRACE=ON. every thread records begin/end
+// events and counters into its own buffer (nobody else writes to it, so there are
+// no locks), trace_dump() writes all of them as chrome trace json that perfetto
+// (ui.perfetto.dev) or chrome://tracing can open. without CLIWAVE_TRACE the
+// macros below are empty and nothing is compiled in at all.
+// names have to be string literals, only the pointer is kept.
+//
+// each thread keeps its newest few hundred thousand events, older ones get written
+// over. until a thread has filled its buffer once, every few thousand events
+// allocate, so a traced build isn't quite realtime safe in the callback
+
+#ifdef CLIWAVE_TRACE
+void trace_begin(const char* name);
+void trace_end(const char* name);
+void trace_counter(const char* name, int64_t value);
+void trace_thread_name(const char* name);
+
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END(name) trace_end(name)
+#define TRACE_COUNTER(name, value) trace_counter(name, (int64_t)(value))
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+// writes everything recorded so far, threads can keep tracing while it runs.
+// returns false if it couldn't write the file or tracing isn't compiled in
+bool trace_dump(const char* path);
+
+#ifdef __cplusplus
+}
+
+#ifdef CLIWAVE_TRACE
+// ends the event when it goes out of scope
+struct TraceScope {
+    const char* name;
+    explicit TraceScope(const char* n) : name(n) { trace_begin(n); }
+    ~TraceScope() { trace_end(name); }
+};
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+#endif
@@ -0,0 +1,55 @@
+#include "uievents.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+UiEventLoop::UiEventLoop() {
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+}
+
+UiEventLoop::~UiEventLoop() {
+    if (timerFd >= 0) close(timerFd);
+}
+
+void UiEventLoop::watch(int fd, int event) {
+    if (fd >= 0) watched.push_back({fd, event});
+}
+
+void UiEventLoop::setTimer(int intervalMs) {
+    if (timerFd < 0 || intervalMs == timerMs) return;
+    timerMs = intervalMs;
+    itimerspec spec{};
+    spec.it_interval.tv_sec = intervalMs / 1000;
+    spec.it_interval.tv_nsec = (long)(intervalMs % 1000) * 1000000;
+    spec.it_value = spec.it_interval; // all zero disarms it
+    timerfd_settime(timerFd, 0, &spec, nullptr);
+}
+
+int UiEventLoop::wait() {
+    // negative fds are skipped by poll, so a missing timer just never fires
+    std::vector<pollfd> fds;
+    fds.push_back({STDIN_FILENO, POLLIN, 0});
+    fds.push_back({timerFd, POLLIN, 0});
+    for (const Watched& w : watched) fds.push_back({w.fd, POLLIN, 0});
+    int ready = poll(fds.data(), fds.size(), -1);
+    if (ready < 0) {
+        // SIGWINCH lands here, ncurses has a KEY_RESIZE queued for getch
+        return errno == EINTR ? UI_EVENT_INPUT : 0;
+    }
+
+    int events = 0;
+    if (fds[0].revents) events |= UI_EVENT_INPUT;
+    for (size_t i = 0; i < watched.size(); i++) {
+        if (fds[i + 2].revents) events |= watched[i].event;
+    }
+    if (fds[1].revents) {
+        uint64_t expirations;
+        ssize_t got = read(timerFd, &expirations, sizeof(expirations));
+        (void)got;
+        events |= UI_EVENT_TIMER;
+    }
+    return events;
+}
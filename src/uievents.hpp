@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+// what woke the DAW screen up, wait() returns a mix of these
+enum UiEvent {
+    UI_EVENT_INPUT = 1,   // keys waiting on stdin (or a resize)
+    UI_EVENT_ENGINE = 2,  // the audio engine has something new (playhead, xruns, take start)
+    UI_EVENT_TIMER = 4,   // the refresh timer went off
+    UI_EVENT_PEAKS = 8,   // a peak file finished building
+    UI_EVENT_EXPORT = 16, // an export started or finished
+};
+
+// blocks in poll() on stdin, a timerfd and whatever eventfds get watched (the
+// engine, the peak builder, the exports), so the ui sleeps for as long as nothing changes
+// instead of waking up every few ms.
+class UiEventLoop {
+public:
+    UiEventLoop();
+    ~UiEventLoop();
+
+    // wait() reports event when fd becomes readable. negative fds are ignored
+    void watch(int fd, int event);
+    // fires every intervalMs until changed, 0 turns it off
+    void setTimer(int intervalMs);
+    int wait();
+
+private:
+    struct Watched {
+        int fd;
+        int event;
+    };
+    std::vector<Watched> watched;
+    int timerFd;
+    int timerMs = 0;
+};
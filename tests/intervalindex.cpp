@@ -0,0 +1,95 @@
+// checks IntervalIndex::overlapping against going through every span, on random
+// spans of every index size up to a few hundred. the queries start and end right
+// on span edges as often as in between, and some spans are zero length
+#include "intervalindex.hpp"
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+static int failures = 0;
+
+static void check(const IntervalIndex& index, const std::vector<IntervalIndex::Span>& spans, uint64_t from, uint64_t to) {
+    std::vector<uint32_t> expected;
+    if (from < to) {
+        for (const auto& span : spans) {
+            if (span.start < to && span.end > from) expected.push_back(span.id);
+        }
+    }
+
+    std::vector<uint32_t> got;
+    uint64_t lastStart = 0;
+    bool ordered = true;
+    index.overlapping(from, to, [&](const IntervalIndex::Span& span) {
+        if (span.start < lastStart) ordered = false;
+        lastStart = span.start;
+        got.push_back(span.id);
+    });
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(got.begin(), got.end());
+    if (got != expected || !ordered) {
+        if (failures++ < 10) {
+            fprintf(stderr, "%zu spans, [%llu, %llu): got %zu, expected %zu%s\n", spans.size(), (unsigned long long)from,
+                    (unsigned long long)to, got.size(), expected.size(), ordered ? "" : ", out of start order");
+        }
+    }
+}
+
+// somewhere near the spans: on an edge, one off it or anywhere
+static uint64_t pickPoint(const std::vector<IntervalIndex::Span>& spans, Rng& rng, uint64_t range) {
+    if (spans.empty() || rng.below(3) == 0) return rng.below(range + 2);
+    const auto& span = spans[rng.below(spans.size())];
+    uint64_t edge = rng.below(2) ? span.start : span.end;
+    switch (rng.below(3)) {
+    case 0: return edge;
+    case 1: return edge + 1;
+    default: return edge ? edge - 1 : 0;
+    }
+}
+
+int main() {
+    Rng rng = {7};
+
+    IntervalIndex empty;
+    std::vector<IntervalIndex::Span> none;
+    check(empty, none, 0, 100);
+    empty.assign(none);
+    check(empty, none, 0, UINT64_MAX);
+
+    for (size_t count = 1; count <= 300; count++) {
+        for (int round = 0; round < 8; round++) {
+            // a small range makes for lots of shared starts and ends
+            uint64_t range = round % 2 ? 64 : 100000;
+            std::vector<IntervalIndex::Span> spans;
+            for (size_t i = 0; i < count; i++) {
+                uint64_t start = rng.below(range);
+                uint64_t length = rng.below(4) == 0 ? 0 : 1 + rng.below(round < 4 ? range / 8 : range);
+                spans.push_back({start, start + length, (uint32_t)i});
+            }
+            IntervalIndex index;
+            index.assign(spans);
+            if (index.size() != spans.size()) {
+                fprintf(stderr, "%zu spans went in, the index has %zu\n", spans.size(), index.size());
+                failures++;
+            }
+
+            check(index, spans, 0, UINT64_MAX);
+            for (int q = 0; q < 32; q++) {
+                uint64_t a = pickPoint(spans, rng, range);
+                uint64_t b = pickPoint(spans, rng, range);
+                // from >= to on purpose now and then, that has to find nothing
+                check(index, spans, a, b);
+                check(index, spans, a, a + 1);
+            }
+        }
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d queries didn't match\n", failures);
+        return 1;
+    }
+    printf("overlapping matches the brute force scan\n");
+    return 0;
+}
@@ -0,0 +1,105 @@
+// renders the same synthetic session with one thread and with four and checks the
+// two files are identical, byte for byte. the takes mix rates and channel counts
+// so the resamplers and the channel conversion are in there too
+//
+//   cliwave_test_mixdown_determinism DIR
+#include "engine.hpp"
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+static bool buildSession(const std::string& dir, std::vector<std::vector<Segment>>& tracks, int64_t& sessionFrames) {
+    const int rates[] = {44100, 48000, 22050};
+    const int channels[] = {1, 2};
+    const uint64_t segmentFrames = 3 * ENGINE_SAMPLE_RATE;
+    const uint64_t slackFrames = ENGINE_SAMPLE_RATE / 2;
+    sessionFrames = 20 * ENGINE_SAMPLE_RATE;
+    Rng rng = {42};
+
+    std::vector<std::string> takes;
+    for (int i = 0; i < 6; i++) {
+        int rate = rates[i % 3];
+        uint64_t frames = ((segmentFrames + slackFrames) * (uint64_t)rate + ENGINE_SAMPLE_RATE - 1) / ENGINE_SAMPLE_RATE;
+        std::string path = dir + "/take_" + std::to_string(i) + ".wav";
+        Rng takeRng = {1000ULL + i};
+        if (!writeSyntheticTake(path, rate, channels[i % 2], frames, takeRng)) {
+            fprintf(stderr, "Couldn't write %s\n", path.c_str());
+            return false;
+        }
+        takes.push_back(path);
+    }
+
+    // more tracks than threads, overlapping inside a track and running past the end
+    tracks.assign(8, std::vector<Segment>());
+    for (size_t t = 0; t < tracks.size(); t++) {
+        for (int s = 0; s < 8; s++) {
+            Segment seg;
+            seg.startFrame = (int64_t)rng.below((uint64_t)sessionFrames);
+            seg.frameCount = (int64_t)segmentFrames;
+            seg.sourceOffset = (int64_t)rng.below(slackFrames);
+            seg.filename = takes[rng.below(takes.size())];
+            tracks[t].push_back(seg);
+        }
+        std::sort(tracks[t].begin(), tracks[t].end(),
+                  [](const Segment& a, const Segment& b) { return a.startFrame < b.startFrame; });
+    }
+    return true;
+}
+
+static bool readFile(const std::string& path, std::vector<char>& data) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char buffer[65536];
+    size_t n;
+    data.clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + n);
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string dir = argc > 1 ? argv[1] : "/tmp/cliwave-test";
+    mkdir(dir.c_str(), 0755);
+
+    std::vector<std::vector<Segment>> tracks;
+    int64_t sessionFrames = 0;
+    if (!buildSession(dir, tracks, sessionFrames)) return 1;
+
+    std::vector<char> outputs[2];
+    const unsigned threads[2] = {1, 4};
+    for (int i = 0; i < 2; i++) {
+        std::string path = dir + "/mix_" + std::to_string(threads[i]) + ".wav";
+        MixdownOptions options;
+        options.threads = threads[i];
+        MixdownStats stats;
+        if (!mixdownTracks(tracks, sessionFrames, path, options, &stats)) {
+            fprintf(stderr, "Mixdown with %u threads failed\n", threads[i]);
+            return 1;
+        }
+        if (stats.threads != threads[i]) {
+            fprintf(stderr, "Asked for %u threads, the mixdown used %u\n", threads[i], stats.threads);
+            return 1;
+        }
+        if (!readFile(path, outputs[i])) {
+            fprintf(stderr, "Couldn't read %s\n", path.c_str());
+            return 1;
+        }
+    }
+
+    if (outputs[0].size() != outputs[1].size()) {
+        fprintf(stderr, "1 thread wrote %zu bytes, 4 threads wrote %zu\n", outputs[0].size(), outputs[1].size());
+        return 1;
+    }
+    for (size_t i = 0; i < outputs[0].size(); i++) {
+        if (outputs[0][i] != outputs[1][i]) {
+            fprintf(stderr, "The mixes differ first at byte %zu of %zu\n", i, outputs[0].size());
+            return 1;
+        }
+    }
+    printf("%zu bytes, identical with 1 and 4 threads\n", outputs[0].size());
+    return 0;
+}